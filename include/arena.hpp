@@ -26,6 +26,7 @@ public:
 
   struct monotonic_arena
   {
+    friend struct monotonic_buffer;
   private:
     std::unique_ptr<monotonic_item[]> storage;
     std::unique_ptr<monotonic_arena> next;
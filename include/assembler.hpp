@@ -14,10 +14,11 @@ namespace ass
     static program parse_code(const std::string& text);
 
   private:
-    assembler(const std::vector<ass::instruction>& v);
+    assembler(std::vector<ass::instruction> v);
 
     void phase_one();
     void phase_two();
+    void phase_three();
   private:
     program prog;
   };
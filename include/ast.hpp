@@ -2,7 +2,11 @@
 
 #include <source_range.hpp>
 #include <ast_nodes.hpp>
+#include <ast_arena.hpp>
 #include <memory>
+#include <type_traits>
+
+class thread_pool;
 
 struct ast_base
 {
@@ -10,14 +14,15 @@ struct ast_base
 
   ASTNodeKind kind;
 
-  std::shared_ptr<ast_base> type { nullptr };
-  std::shared_ptr<ast_base> annot { nullptr };
+  ast_base* type { nullptr };
+  ast_base* annot { nullptr };
 };
-using ast_ptr = std::shared_ptr<ast_base>;
+// Nodes live in the ast_arena of their module, see hx_ast::arena.
+using ast_ptr = ast_base*;
 
 struct identifier : ast_base
 {
-  using ptr = std::shared_ptr<identifier>;
+  using ptr = identifier*;
 
   identifier(symbol symb)
     : ast_base(ASTNodeKind::identifier), symb(symb)
@@ -25,22 +30,24 @@ struct identifier : ast_base
 
   symbol symb;
 };
+// the arena runs no destructor for trivially destructible nodes, and identifiers are the most common
+static_assert(std::is_trivially_destructible_v<identifier>, "Identifiers must not need a destructor.");
 
 struct unit : ast_base
-{ using ptr = std::shared_ptr<unit>; unit() : ast_base(ASTNodeKind::unit) {} };
+{ using ptr = unit*; unit() : ast_base(ASTNodeKind::unit) {} };
 
 struct prop : ast_base
-{ using ptr = std::shared_ptr<prop>; prop() : ast_base(ASTNodeKind::Prop) {} };
+{ using ptr = prop*; prop() : ast_base(ASTNodeKind::Prop) {} };
 
 struct type : ast_base
-{ using ptr = std::shared_ptr<type>; type() : ast_base(ASTNodeKind::Type) {} };
+{ using ptr = type*; type() : ast_base(ASTNodeKind::Type) {} };
 
 struct kind : ast_base
-{ using ptr = std::shared_ptr<kind>; kind() : ast_base(ASTNodeKind::Kind) {} };
+{ using ptr = kind*; kind() : ast_base(ASTNodeKind::Kind) {} };
 
 struct app : ast_base
 {
-  using ptr = std::shared_ptr<app>;
+  using ptr = app*;
 
   app(ast_ptr lhs, ast_ptr rhs) : ast_base(ASTNodeKind::app), lhs(lhs), rhs(rhs)
   {  }
@@ -51,7 +58,7 @@ struct app : ast_base
 
 struct lambda : ast_base
 {
-  using ptr = std::shared_ptr<lambda>;
+  using ptr = lambda*;
 
   lambda(ast_ptr lhs, ast_ptr rhs) : ast_base(ASTNodeKind::lambda), lhs(lhs), rhs(rhs)
   {  }
@@ -62,7 +69,7 @@ struct lambda : ast_base
 
 struct match : ast_base
 {
-  using ptr = std::shared_ptr<match>;
+  using ptr = match*;
 
   match(ast_ptr pat, ast_ptr exp) : ast_base(ASTNodeKind::match), pat(pat), exp(exp)
   {  }
@@ -73,7 +80,7 @@ struct match : ast_base
 
 struct pattern_matcher : ast_base
 {
-  using ptr = std::shared_ptr<pattern_matcher>;
+  using ptr = pattern_matcher*;
 
   pattern_matcher(ast_ptr to_match, std::vector<ast_ptr> patterns)
     : ast_base(ASTNodeKind::pattern_matcher), to_match(to_match), data(patterns)
@@ -85,7 +92,7 @@ struct pattern_matcher : ast_base
 
 struct assign : ast_base
 {
-  using ptr = std::shared_ptr<assign>;
+  using ptr = assign*;
 
   assign(ast_ptr lhs, ast_ptr rhs) : ast_base(ASTNodeKind::assign), lhs(lhs), rhs(rhs)
   {  }
@@ -96,7 +103,7 @@ struct assign : ast_base
 
 struct assign_type : ast_base
 {
-  using ptr = std::shared_ptr<assign_type>;
+  using ptr = assign_type*;
 
   assign_type(ast_ptr lhs, ast_ptr rhs) : ast_base(ASTNodeKind::assign_type), lhs(lhs), rhs(rhs)
   {  }
@@ -107,7 +114,7 @@ struct assign_type : ast_base
 
 struct assign_data : ast_base
 {
-  using ptr = std::shared_ptr<assign_data>;
+  using ptr = assign_data*;
 
   assign_data(ast_ptr lhs, ast_ptr rhs) : ast_base(ASTNodeKind::assign_data), lhs(lhs), rhs(rhs)
   {  }
@@ -118,7 +125,7 @@ struct assign_data : ast_base
 
 struct expr_stmt : ast_base
 {
-  using ptr = std::shared_ptr<expr_stmt>;
+  using ptr = expr_stmt*;
 
   expr_stmt(ast_ptr lhs) : ast_base(ASTNodeKind::expr_stmt), lhs(lhs)
   {  }
@@ -136,8 +143,12 @@ struct hx_ast
   { tsl::robin_set<identifier::ptr> binders; return used(what, in, binders); }
   static bool used(ast_ptr what, ast_ptr in, tsl::robin_set<identifier::ptr>& binders);
 
-  bool type_checks() const;
+  // Consecutive statements that don't depend on each other are checked in parallel on `pool`, if
+  //  it has more than one thread. Result and diagnostics are the same either way.
+  bool type_checks(thread_pool* pool = nullptr) const;
 
+  // Owns the nodes of `data`. Copies of a module share it, so it lives as long as any of them.
+  std::shared_ptr<ast_arena> arena { std::make_shared<ast_arena>() };
   std::vector<ast_ptr> data;
 };
 
@@ -0,0 +1,66 @@
+#pragma once
+
+#include <type_traits>
+#include <cstddef>
+#include <cstdint>
+#include <utility>
+#include <memory>
+#include <vector>
+#include <new>
+
+/**
+ * Bump allocator for the nodes of a module.
+ *
+ * Nodes are carved out of blocks that double in size and are never freed one by one, they all
+ *  die with the arena. Nodes that need a destructor get it run then, newest first.
+ * An arena must only be used by one thread at a time.
+ */
+class ast_arena
+{
+public:
+  ast_arena() = default;
+  ~ast_arena();
+
+  ast_arena(ast_arena&& other);
+  ast_arena& operator=(ast_arena&&) = delete;
+
+  ast_arena(const ast_arena&) = delete;
+  ast_arena& operator=(const ast_arena&) = delete;
+
+  template<typename T, typename... Args>
+  T* make(Args&&... args)
+  {
+    T* node = new(allocate(sizeof(T), alignof(T))) T(std::forward<Args>(args)...);
+
+    if constexpr(!std::is_trivially_destructible_v<T>)
+      destructors.push_back({ node, [](void* p) { static_cast<T*>(p)->~T(); } });
+    return node;
+  }
+
+  // bytes handed out so far
+  std::size_t size() const;
+private:
+  void* allocate(std::size_t size, std::size_t align)
+  {
+    const std::size_t pad = (align - reinterpret_cast<std::uintptr_t>(cur) % align) % align;
+    if(cur == nullptr || static_cast<std::size_t>(end - cur) < pad + size)
+      return allocate_block(size, align);
+
+    void* p = cur + pad;
+    cur += pad + size;
+    used += pad + size;
+    return p;
+  }
+
+  void* allocate_block(std::size_t size, std::size_t align);
+private:
+  static constexpr std::size_t first_block_size = 4096;
+
+  std::vector<std::unique_ptr<char[]>> blocks;
+  char* cur { nullptr };
+  char* end { nullptr };
+  std::size_t next_block_size { first_block_size };
+  std::size_t used { 0 };
+
+  std::vector<std::pair<void*, void(*)(void*)>> destructors;
+};
@@ -1,5 +1,6 @@
 #pragma once
 
+#include <thread_pool.hpp>
 #include <config.hpp>
 
 template<bool print_newline>
@@ -12,6 +13,11 @@ struct printer
 
 struct compiler
 {
+  // sized by config.num_cores, so the config has to be parsed first
+  compiler();
+
   void go();
+private:
+  thread_pool pool;
 };
 
@@ -50,7 +50,7 @@ namespace detail
     std::size_t col;
   };
   inline bool operator<(const position& lhs, const position& rhs)
-  { return lhs.row < rhs.row && lhs.col < rhs.col && lhs.module.get_hash() == rhs.module.get_hash(); }
+  { return lhs.row < rhs.row && lhs.col < rhs.col && lhs.module == rhs.module; }
 
   inline position make_position(symbol module, std::size_t row, std::size_t col)
   {
@@ -71,6 +71,11 @@ public:
 
   diagnostics_manager& operator<<=(const json::json& msg);
 
+  // Diagnostics of the calling thread are appended to `buffer` instead of being recorded, until
+  //  the previous buffer, which is returned, is installed again. Parallel work uses this to hand
+  //  on its diagnostics in a deterministic order.
+  static std::vector<json::json>* capture(std::vector<json::json>* buffer);
+
   bool empty() const { return data.empty(); }
 
   void print(std::FILE* file);
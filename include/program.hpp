@@ -13,15 +13,27 @@ namespace ass
                                               std::pair<symbol_type, std::size_t>>;
     friend struct assembler;
 
-    program(const std::vector<ass::instruction>& instr) : instructions(instr)
+    program(std::vector<ass::instruction> instr) : instructions(std::move(instr))
     {  }
 
     program() : instructions()
     {  }
 
+    // Encodes all instructions into one buffer that is allocated upfront.
     std::vector<unsigned char> to_u8_vec() const;
 
+    // the assembled bytes, including superinstructions
+    const std::vector<unsigned char>& get_bytes() const &
+    { return bytes; }
+
+    // lets the bytes of a temporary program move on, e.g. into vm::set_program
+    std::vector<unsigned char> get_bytes() &&
+    { return std::move(bytes); }
+
     const std::pair<symbol_type, std::size_t>& lookup_symbol(const symbol& name) const;
+
+    // all symbols with their names, in the order they are defined
+    std::vector<symbol_entry> symbols() const;
   private:
     std::vector<ass::instruction> instructions;
     std::vector<unsigned char> bytes;
@@ -1,6 +1,7 @@
 #pragma once
 
 #include <source_range.hpp>
+#include <source_file.hpp>
 #include <fixit_info.hpp>
 #include <symbol.hpp>
 #include <token.hpp>
@@ -14,25 +15,29 @@
 #include <vector>
 #include <string>
 
+// Reads from the whole text of a source at once, see source_file.
 class base_reader
 {
-public:
-  ~base_reader();
 protected:
   base_reader(std::string_view module);
-  base_reader(std::istream& stream);
+  base_reader(source_file text);
 
   char getc();
+private:
+  // moves `linebuf` to the next line, false at the end of the text
+  bool next_line();
 protected:
   std::string_view module;
-  std::istream& is;
+  std::shared_ptr<const source_file> src;
+  source_stream* stream { nullptr }; // read line by line instead of `src` if set
 
-  std::string linebuf;
+  // the current line without its '\n', points into `src`
+  std::string_view linebuf;
 
   std::size_t col;
   std::size_t row;
 private:
-  bool uses_reader { false };
+  std::size_t next_line_pos { 0 };
 };
 
 /// HX_READER
@@ -67,7 +72,7 @@ private:
     consume(); 
   }
 
-  hx_reader(std::istream& is) : base_reader(is)
+  hx_reader(source_file text) : base_reader(std::move(text))
   {
     for(std::size_t i = 0; i < next_toks.size(); ++i)
       consume();
@@ -109,6 +114,7 @@ private:
   token current;
   std::array<token, lookahead_size> next_toks;
   scoping_context scoping_ctx;
+  ast_arena* arena { nullptr }; // of the module being read
 
   bool parsing_pattern { false };
   bool parsing_constructor { false };
@@ -139,7 +145,7 @@ private:
     consume(); 
   }
 
-  asm_reader(std::istream& is) : base_reader(is)
+  asm_reader(source_file text) : base_reader(std::move(text))
   {
     for(std::size_t i = 0; i < next_toks.size(); ++i)
       consume();
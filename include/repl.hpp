@@ -2,10 +2,12 @@
 
 #include <string>
 #include <vector>
+#include <memory>
 
 #include <type_checking.hpp>
 #include <reader.hpp>
 #include <vm.hpp>
+#include <vm_symbol_table.hpp>
 
 /**
  * This REPL ("Repeat, Enter, Process"-Loop) is intended
@@ -43,6 +45,10 @@ namespace hx
     typing_context tctx;
     scoping_context sctx;
 
+    // tctx and sctx refer to nodes of every input so far
+    std::vector<std::shared_ptr<ast_arena>> inputs;
+    ast_arena terms; // made by the type checker
+
     std::size_t failed_inputs { 0 };
   };
 
@@ -66,8 +72,19 @@ namespace virt
     void program();
     void registers();
     void load();
+
+    void profile();
+    void dump_profile();
+
+    void load_bytecode();
+    void write_bytecode();
   private:
     vm virt_mach;
+    vm_profile last_profile;
+
+    // labels of the loaded program, 'write-bytecode stores them along with it
+    std::vector<ass::symbol_entry> labels;
+    std::shared_ptr<const void> labels_owner; // the file that label names read from bytecode point into
 
     std::size_t failed_inputs;
   };
@@ -0,0 +1,85 @@
+#pragma once
+
+#include <string_view>
+#include <optional>
+#include <iosfwd>
+#include <string>
+#include <vector>
+
+/**
+ * The whole text of a source, in one contiguous buffer.
+ *
+ * Regular files are mapped read-only. Everything else that can't be mapped, like pipes, is
+ *  read in one go. Text that already lives in memory can be wrapped without a copy, it has to
+ *  outlive the source_file then.
+ */
+class source_file
+{
+public:
+  // An empty source if `path` can't be opened.
+  static source_file open(const std::string& path);
+
+  static source_file from_text(std::string_view text);
+
+  // owns a copy of `text`
+  static source_file copy_of(std::string_view text);
+
+  source_file();
+  ~source_file();
+
+  source_file(source_file&& other);
+  source_file& operator=(source_file&& other);
+
+  source_file(const source_file&) = delete;
+  source_file& operator=(const source_file&) = delete;
+
+  std::string_view text() const;
+private:
+  const char* data;
+  std::size_t size;
+
+  bool mapped;
+  std::vector<char> contents; // only used if the file couldn't be mapped
+};
+
+/**
+ * Input that can only be read once from front to back, like a pipe.
+ *
+ * It is read in chunks and handed out line by line, so memory is bounded by the chunk size,
+ *  the longest line and the lines kept for diagnostics. Nothing is written anywhere.
+ * The most recent `kept_lines` lines stay available through `kept_line`.
+ */
+class source_stream
+{
+public:
+  static constexpr std::size_t chunk_size = 64 * 1024;
+  static constexpr std::size_t kept_lines = 1024;
+
+  explicit source_stream(std::istream& is);
+
+  source_stream(const source_stream&) = delete;
+  source_stream& operator=(const source_stream&) = delete;
+
+  // Sets `line` to the next line without its '\n', it stays valid until the next call.
+  // Returns false at the end of the input.
+  bool next_line(std::string_view& line);
+
+  // Line `row`, counting from 1, if it is still kept.
+  std::optional<std::string_view> kept_line(std::size_t row) const;
+
+  // the oldest line that is still kept, 1 if nothing was read yet
+  std::size_t first_kept_row() const;
+  std::size_t rows_read() const;
+private:
+  bool fill();
+private:
+  std::istream& is;
+
+  std::vector<char> buffer;
+  std::size_t line_begin;
+  std::size_t filled;
+  bool at_end;
+
+  std::vector<std::string> ring; // line `row` lives at `(row - 1) % kept_lines`
+  std::size_t rows;
+};
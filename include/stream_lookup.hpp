@@ -1,36 +1,60 @@
 #pragma once
 
+#include <source_file.hpp>
+
 #include <unordered_map>
 #include <string_view>
-#include <fstream>
 #include <memory>
-#include <vector>
-#include <iosfwd>
-
+#include <array>
+#include <mutex>
+#include <string>
+
+/**
+ * Registry of the sources of all modules, safe to use from any thread.
+ *
+ * A module is loaded the first time someone asks for it, everyone asking afterwards shares the
+ *  same buffer, e.g. the diagnostics printer reuses what the reader loaded. The shared_ptr is the
+ *  handle to a module, dropping a module only removes it from the registry, the buffer lives on
+ *  until its last handle is gone.
+ * Modules are spread over shards by name, so threads working on different modules rarely wait
+ *  for each other.
+ */
 struct stream_lookup_t
 {
   stream_lookup_t();
-  ~stream_lookup_t();
 
-  std::istream& operator[](std::string_view str);
+  // The whole text of a module. For STDIN these are only the lines that were kept while it was read, see first_row.
+  std::shared_ptr<const source_file> operator[](std::string_view str);
   void drop(std::string_view str);
 
+  // the row that the text returned by operator[] starts at
+  std::size_t first_row(std::string_view str);
+
+  // Modules that can only be read once, line by line, i.e. STDIN. nullptr for all others.
+  source_stream* line_stream(std::string_view str);
+
 #ifdef H_LANG_TESTING
   void write_test(std::string_view str);
 #endif
 private:
-  void process_stdin();
-private:
-  std::vector<std::unique_ptr<std::ifstream>> files;
+  static constexpr std::size_t shard_count = 16;
+
+  struct shard
+  {
+    std::mutex lock;
+    std::unordered_map<std::string, std::shared_ptr<const source_file>> modules;
+  };
 
-  std::unordered_map<std::string_view, std::vector<std::unique_ptr<std::ifstream>>::iterator> map;
+  std::string_view resolve(std::string_view str);
+  shard& shard_of(std::string_view str);
+private:
+  std::array<shard, shard_count> shards;
 
-  std::string stdin_module;
+  std::once_flag stdin_opened;
+  std::unique_ptr<source_stream> stdin_stream;
 #ifdef H_LANG_TESTING
   std::string test_module;
 #endif
-
-  bool stdin_processed { false };
 };
 
 inline stream_lookup_t stream_lookup;
@@ -8,14 +8,19 @@
 #include <iosfwd>
 #include <string>
 #include <ostream>
+#include <string_view>
 
+// An interned string.
+// Every distinct string gets the next free id from the interner, so ids are dense,
+//  two symbols are equal exactly when their strings are, and the id is a perfect hash.
 struct symbol
 {
   symbol(const std::string& str);
   symbol(const char* str);
+  symbol(std::string_view str);
   symbol(const symbol& s);
   symbol(symbol&& s);
-  ~symbol() noexcept;
+  ~symbol() = default;
 
   symbol& operator=(const std::string& str);
   symbol& operator=(const char* str);
@@ -25,23 +30,23 @@ struct symbol
   friend std::ostream& operator<<(std::ostream& os, const symbol& s);
 
   const std::string& get_string() const;
-  std::uint_fast64_t get_hash() const;
+  std::uint32_t get_id() const;
 private:
-  static std::string& lookup_or_emplace(std::uint_fast64_t hash, const char* str);
+  // The interned strings are shared by all threads, see src/symbol.cpp.
+  static std::uint32_t lookup_or_emplace(std::string_view str);
+  static const std::string& lookup(std::uint32_t id);
 private:
-  static tsl::robin_map<std::uint_fast64_t, std::string> symbols;
-
-  std::uint_fast64_t hash;
+  std::uint32_t id;
 };
 struct symbol_hasher
 {
   std::size_t operator()(symbol symb) const
-  { return symb.get_hash(); }
+  { return symb.get_id(); }
 };
 struct symbol_comparer
 {
   bool operator()(symbol lhs, symbol rhs) const
-  { return lhs.get_hash() == rhs.get_hash(); }
+  { return lhs.get_id() == rhs.get_id(); }
 };
 
 template<class T, bool store_hash = false>
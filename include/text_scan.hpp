@@ -0,0 +1,37 @@
+#pragma once
+
+#include <string_view>
+
+/**
+ * Vectorized scanning of source text for the readers.
+ *
+ * Every function has an AVX2, an SSE2 and a scalar version, the best one the cpu supports
+ *  is picked on first use. None of them depends on the locale.
+ */
+
+// ' ', '\t', '\n', '\v', '\f' and '\r', what std::isspace accepts in the "C" locale
+constexpr bool is_line_space(char c)
+{ return c == ' ' || ('\t' <= c && c <= '\r'); }
+
+// Characters that end an identifier or a number: control characters, ' ' and the operator
+//  characters of hx, which lie in a few ranges of ASCII:  ( ) * + , - .   : ;   =   [ \ ]   { | }
+// Bytes of multibyte UTF-8 sequences never end a word.
+constexpr bool is_word_break(char c)
+{
+  const unsigned char u = static_cast<unsigned char>(c);
+  return u <= ' ' || u == 127
+      || ('(' <= u && u <= '.')
+      || u == ':' || u == ';' || u == '='
+      || ('[' <= u && u <= ']')
+      || ('{' <= u && u <= '}');
+}
+
+// Returns the first character in [first, last) that isn't line whitespace, or `last`.
+const char* skip_line_spaces(const char* first, const char* last);
+
+// Returns the first character in [first, last) that ends an identifier or a number, or `last`.
+const char* find_word_break(const char* first, const char* last);
+
+// "avx2", "sse2" or "scalar"
+std::string_view text_scan_implementation();
+
@@ -0,0 +1,66 @@
+#pragma once
+
+#include <condition_variable>
+#include <functional>
+#include <cstddef>
+#include <memory>
+#include <vector>
+#include <thread>
+#include <deque>
+#include <mutex>
+
+/**
+ * Persistent pool of worker threads for independent jobs.
+ *
+ * Every worker has a queue of its own. Jobs submitted from outside are dealt out round robin,
+ *  jobs submitted by a running job go to the queue of its worker. A worker takes the newest job
+ *  of its own queue and, once that is empty, steals the oldest job of another one.
+ * Workers without anything to do sleep on a condition variable, so an idle pool uses no cpu.
+ */
+class thread_pool
+{
+public:
+  // A `threads` count of zero uses one thread per hardware thread.
+  explicit thread_pool(std::size_t threads = 0);
+
+  // Finishes all submitted jobs before the workers stop.
+  ~thread_pool();
+
+  thread_pool(const thread_pool&) = delete;
+  thread_pool& operator=(const thread_pool&) = delete;
+
+  void submit(std::function<void()> job);
+
+  // Blocks until every job submitted so far has finished. Must not be called from a job.
+  void wait();
+
+  // Runs `job(0)` to `job(count - 1)` and returns once all of them have finished. The calling
+  //  thread takes part, so unlike `wait` this may be called from a job of the pool.
+  void for_each(std::size_t count, std::function<void(std::size_t)> job);
+
+  std::size_t thread_count() const;
+
+  // The pool of the worker running the calling thread, nullptr outside of any pool.
+  static thread_pool* current();
+private:
+  struct alignas(64) job_queue
+  {
+    std::mutex lock;
+    std::deque<std::function<void()>> jobs;
+  };
+
+  void work(std::size_t id);
+  bool pop(std::size_t id, std::function<void()>& job);
+private:
+  std::vector<std::unique_ptr<job_queue>> queues;
+  std::vector<std::thread> workers;
+
+  std::mutex state_lock;
+  std::condition_variable wake;  // there are queued jobs or the pool stops
+  std::condition_variable idle;  // no job is pending anymore
+  std::size_t queued { 0 };      // submitted and not started yet, guarded by state_lock
+  std::size_t pending { 0 };     // submitted and not finished yet, guarded by state_lock
+  std::size_t next_queue { 0 };  // guarded by state_lock
+  bool stopping { false };       // guarded by state_lock
+};
+
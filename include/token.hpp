@@ -6,6 +6,8 @@
 
 #include <cstdint>
 #include <cstdio>
+#include <cassert>
+#include <array>
 
 namespace ass
 {
@@ -88,7 +90,11 @@ public:
     : kind(ass::token_kind::Undef), opc(op_code::UNKNOWN), data(""), loc()
   {  }
 
-  std::vector<unsigned char> to_u8_vec(const ass::program& assm) const;
+  // number of bytes `encode` writes
+  std::size_t encoded_size() const;
+
+  // Writes the operand to `out` and returns the end of what was written.
+  unsigned char* encode(unsigned char* out, const ass::program& assm) const;
 
   ass::token_kind kind;
   op_code opc;
@@ -103,14 +109,32 @@ namespace ass
 {
   using token = generic_token<ass::token_kind>;
 
+  // operands of one instruction, stored inline since there are at most three
+  struct operand_list
+  {
+    void push_back(const token& t)
+    {
+      assert(count < data.size() && "Instructions have at most three operands.");
+      data[count++] = t;
+    }
+
+    const token* begin() const { return data.data(); }
+    const token* end() const { return data.data() + count; }
+    std::size_t size() const { return count; }
+
+    std::array<token, 3> data;
+    std::size_t count { 0 };
+  };
+
   struct instruction
   {
-    std::vector<unsigned char> to_u8_vec(const program& assm) const;
+    std::size_t encoded_size() const;
+    unsigned char* encode(unsigned char* out, const program& assm) const;
 
     std::optional<op_code> op;
     std::optional<token> lab;
     std::optional<token> dir;
-    std::vector<ass::token> args;
+    operand_list args;
   };
 }
 
@@ -3,17 +3,24 @@
 #include <symbol.hpp>
 #include <ast.hpp>
 
+#include <tsl/robin_map.h>
+#include <tsl/robin_set.h>
+
+#include <vector>
+
+class thread_pool;
+
 struct exist;
 struct CTXElement
 {
-  CTXElement(std::shared_ptr<exist> ex) : existential(ex)
+  CTXElement(exist* ex) : existential(ex)
   {  }
 
   CTXElement(identifier::ptr id, ast_ptr type)
     : id_def(id), type(type)
   {  }
 
-  std::shared_ptr<exist> existential { nullptr }; 
+  exist* existential                 { nullptr };
   identifier::ptr id_def             { nullptr }; // <- absolute position of the binding occurence of id
   ast_ptr type                       { nullptr }; // <- absolute position of a type
 };
@@ -33,7 +40,123 @@ struct typing_context
   pos lookup_type(pos begin, ast_ptr type) const;
   pos lookup_ex(pos begin, ast_ptr ex) const;
 
+  // The context is an ordered list, indexed by binder and by the name of existentials, which
+  //  makes lookup_id and lookup_ex constant time. It is only changed through these.
+  void push(CTXElement elem);
+  pos insert(pos before, CTXElement elem); // returns the position of `elem`
+  void truncate(pos from);                 // drops everything from `from` on
+  void clear();
+
+  // Solved existentials form a union-find forest. root_of returns the root of the tree of `ex`,
+  //  either an unsolved existential or the term all of them are solved with, and points every
+  //  existential on the way directly to it. solve links the tree of `ex` to `with`, or to its
+  //  root if that is an existential too. Solving changes the context as well.
+  ast_ptr root_of(exist* ex);
+  void solve(exist* ex, ast_ptr with);
+
+  // Snapshots are taken in constant time. Every change made after one, solutions of existentials
+  //  included, is logged until the snapshot is rolled back or kept, newest snapshot first. The
+  //  terms themselves are still updated in place and keep their types.
+  struct snapshot
+  { std::size_t trail; };
+
+  snapshot save();
+  void rollback(snapshot to);
+  void keep(snapshot s);
+
+  pos begin() const;
+  pos end() const;
+  std::size_t size() const;
+
+  // Applications and lambdas built by the checker are hash-consed, one node per pair of children.
+  //  Equal types built that way are the same node, eqb only has to compare pointers then.
+  ast_ptr make_app(ast_ptr lhs, ast_ptr rhs);
+  ast_ptr make_lambda(ast_ptr lhs, ast_ptr rhs);
+
+  ast_arena* arena { nullptr }; // where new terms go, has to outlive the context
+private:
+  static constexpr std::size_t npos = static_cast<std::size_t>(-1);
+
+  // positions of the elements with one key, ascending
+  struct positions
+  {
+    void add(std::size_t p);
+    bool remove(std::size_t p); // true once none is left
+    void shift(std::size_t p);  // p becomes p + 1
+
+    std::size_t first { npos };
+    std::vector<std::size_t> rest; // only used by keys that occur more than once
+  };
+
+  positions* index_of(const CTXElement& elem);
+  void set_solution(exist* ex, ast_ptr solution);
+  template<typename Pred>
+  pos find(const positions* in, pos begin, Pred pred) const;
+private:
   std::vector<CTXElement> data;
+  tsl::robin_map<const ast_base*, positions> ids; // by id_def
+  symbol_map<positions> exs;                      // by the name of the existential
+
+  struct change
+  {
+    enum { pushed, inserted, truncated, solved } kind;
+    std::size_t at;        // position of the element pushed, inserted or first truncated
+    std::size_t count;     // elements truncated, the last ones of `dropped`
+    exist* ex;
+    ast_ptr solution;      // what `ex` was solved with before
+  };
+  std::size_t saved { 0 }; // snapshots neither rolled back nor kept
+  std::vector<change> trail;
+  std::vector<CTXElement> dropped;
+
+  struct term_key
+  {
+    ASTNodeKind kind;
+    const ast_base* lhs;
+    const ast_base* rhs;
+
+    bool operator==(const term_key& other) const
+    { return kind == other.kind && lhs == other.lhs && rhs == other.rhs; }
+  };
+  struct term_key_hash
+  { std::size_t operator()(const term_key& key) const; };
+
+  tsl::robin_map<term_key, ast_ptr, term_key_hash> consed;
+};
+
+/**
+ * A copy of a context together with a statement to check in it.
+ *
+ * Checking updates the terms it works on in place, so statements that are checked in parallel
+ *  must not share any node. Every node reachable from the context or the statement is copied
+ *  once, uses of an identifier keep pointing to the copy of their binding occurence.
+ */
+struct typing_fork
+{
+  typing_fork(const std::vector<CTXElement>& snapshot, ast_ptr stmt);
+
+  typing_fork(const typing_fork&) = delete;
+  typing_fork& operator=(const typing_fork&) = delete;
+
+  // Hands on to `into` what checking `stmt` changed, in terms of the original nodes: the types,
+  //  annotations and solutions written to the copies and the elements added to `ctx`. New nodes
+  //  go to the arena of `into`.
+  void merge(typing_context& into) const;
+
+  ast_arena nodes; // the copies and everything checking them creates
+  typing_context ctx;
+  ast_ptr stmt;
+private:
+  // a copy as it was made
+  struct copied
+  {
+    ast_ptr original;
+    ast_ptr type;
+    ast_ptr annot;
+    ast_ptr solution;
+  };
+  tsl::robin_map<const ast_base*, copied> originals; // by copy
+  tsl::robin_set<const ast_base*> inherited;         // binders and existentials of the snapshot
 };
 
 struct hx_ast_type_checking
@@ -44,6 +167,11 @@ struct hx_ast_type_checking
 
   ast_ptr find_type(typing_context& ctx, ast_ptr of);
 
+  // Top-level statements that bind something statement `i` refers to, for every `i`, ascending.
+  static std::vector<std::vector<std::size_t>> dependencies(const hx_ast& ast);
+
+  // Checks all top-level statements, see hx_ast::type_checks.
+  static bool check_statements(const hx_ast& ast, thread_pool* pool);
 private:
   bool check(typing_context& ctx, ast_ptr what, ast_ptr type);
   ast_ptr synthesize(typing_context& ctx, ast_ptr what);
@@ -51,8 +179,8 @@ private:
 
   bool is_subtype(typing_context& ctx, ast_ptr A, ast_ptr B);
 
-  bool inst_l(typing_context& ctx, std::shared_ptr<exist> alpha, ast_ptr A);
-  bool inst_r(typing_context& ctx, ast_ptr A, std::shared_ptr<exist> alpha);
+  bool inst_l(typing_context& ctx, exist* alpha, ast_ptr A);
+  bool inst_r(typing_context& ctx, ast_ptr A, exist* alpha);
 
   bool checking_pattern { false };
 
@@ -1,31 +1,145 @@
 #pragma once
 
 #include <vm_opcodes.hpp>
+#include <vm_verifier.hpp>
+#include <vm_jit.hpp>
+#include <vm_profiler.hpp>
+#include <vm_heap.hpp>
 
 #include <vector>
+#include <memory>
 #include <array>
 
+// Computed goto is a GNU extension, so threaded dispatch silently degrades to the switch loop elsewhere.
+#if defined(H_LANG_VM_COMPUTED_GOTO) && (defined(__GNUC__) || defined(__clang__))
+#define H_LANG_VM_HAS_THREADED_DISPATCH 1
+#else
+#define H_LANG_VM_HAS_THREADED_DISPATCH 0
+#endif
+
+enum class vm_dispatch : std::int_fast8_t
+{
+  Switch,   // one call and one switch per instruction, works everywhere
+  Threaded, // each handler jumps straight to the next one (computed goto)
+  Jit,      // compiles hot basic blocks of verified programs to machine code, see vm_jit
+};
+
+// Fixed-width form of one instruction, see vm::set_program.
+struct alignas(16) decoded_instruction
+{
+  op_code op;
+  unsigned char dst;
+  unsigned char src0;
+  unsigned char src1;
+
+  std::int32_t imm;       // immediate operand
+  std::uint32_t target;   // resolved jump target, as index into the decoded stream
+  std::uint32_t offset;   // byte offset of the instruction in the program blob
+};
+
+// An assembled program together with everything that is derived from it ahead of time.
+// It never changes after construction, so any number of vms, also on different threads, can share one.
+struct vm_program
+{
+public:
+  vm_program() = default;
+
+  // With `predecode` set, the blob is additionally translated into a stream of decoded_instructions
+  //  that vm::run() and vm::run_unchecked() execute instead of the bytes. Programs whose jumps don't
+  //  land on instruction boundaries or that name registers which don't exist keep running from the bytes.
+  explicit vm_program(std::vector<unsigned char> bytes, bool predecode = false);
+
+  // Runs `code` where it is without copying it, `owner` keeps the memory behind it alive.
+  vm_program(bytecode_view code, std::shared_ptr<const void> owner, bool predecode = false);
+
+  vm_program(const vm_program&) = delete;
+  vm_program& operator=(const vm_program&) = delete;
+
+  bytecode_view bytes;
+  verification checks;
+
+  std::vector<decoded_instruction> decoded;
+  std::vector<std::uint32_t> decoded_index; // byte offset -> index into `decoded`
+private:
+  bool predecode();
+private:
+  std::vector<unsigned char> storage;
+  std::shared_ptr<const void> owner;
+};
+
 struct vm
 {
 public:
   static constexpr std::size_t register_count = 32;
+  static constexpr vm_dispatch default_dispatch = H_LANG_VM_HAS_THREADED_DISPATCH ? vm_dispatch::Threaded
+                                                                                 : vm_dispatch::Switch;
 public:
-  vm(std::size_t initial_heap_size = 256 * 256);
+  vm(std::size_t initial_heap_size = 256 * 256, vm_dispatch dispatch = default_dispatch);
 
+  // Runs until HALT or until the program counter leaves the program. Also stops in front of an
+  //  instruction that is missing operands or names a register that doesn't exist.
+  // Programs that passed verify_program run without per-instruction checks.
   void run();
 
-  void run_next_instr();
+  // Same as run(), but without checking the program counter before every instruction.
+  // Only use this for programs that pass verify_program.
+  void run_unchecked();
+
+  // Same as run(), but reports every executed instruction to `profile`.
+  // Always interprets the program blob, so that counts and the heat map don't depend on the dispatch mode.
+  void run_profiled(vm_profile& profile);
+
+  // Returns false if there is nothing left to execute.
+  bool run_next_instr();
 
   std::size_t program_counter() const;
   const std::array<std::int_fast32_t, register_count>& registers() const;
 
-  void set_program(const std::vector<unsigned char>& program);
-  const std::vector<unsigned char>& get_program() const;
+  vm_heap& memory();
+
+  // whether the vm stopped at a LOADM or STOREM with an address outside of the heap
+  bool heap_fault() const;
+
+  vm_dispatch dispatch_mode() const;
+
+  // number of times a block entry has to be reached before it gets compiled
+  void set_jit_threshold(std::size_t threshold);
+  std::size_t jit_compiled_blocks() const;
+
+  // see vm_program for `predecode`
+  void set_program(std::vector<unsigned char> program, bool predecode = false);
+  void set_program(std::shared_ptr<const vm_program> program);
+  bytecode_view get_program() const;
+
+  // Puts the vm back into the state it had after construction, except for the program.
+  void reset();
+  void set_registers(const std::array<std::int_fast32_t, register_count>& values);
+
+  bool is_predecoded() const;
+  bool is_verified() const;
+  const verification& verification_result() const;
 private:
   op_code fetch_instr();
 
   unsigned char fetch8();
   std::int_fast16_t fetch16();
+
+  template<op_code op>
+  void exec();
+
+  bool dispatch(op_code op);
+  bool valid_operands() const;
+  bool valid_jump_target() const;
+  void report_heap_fault(std::int_fast32_t addr);
+
+  template<bool checked, typename profiler>
+  void run_switch(profiler& prof);
+  template<bool checked, typename profiler>
+  void run_threaded(profiler& prof);
+
+  bool run_decoded();
+
+  void run_jit();
 private:
   std::array<std::int_fast32_t, register_count> regs;
 
@@ -33,8 +147,13 @@ private:
   std::size_t pc;
 
   bool compare_flag;
+  vm_dispatch dispatch_kind;
+
+  std::shared_ptr<const vm_program> program;
+
+  vm_heap heap;
+  bool faulted;
 
-  std::vector<unsigned char> program_blob;
-  std::vector<unsigned char> heap;
+  std::unique_ptr<vm_jit> jit;
 };
 
@@ -0,0 +1,84 @@
+#pragma once
+
+#include <vm.hpp>
+#include <vm_symbol_table.hpp>
+
+#include <string_view>
+#include <cstdint>
+#include <memory>
+#include <vector>
+#include <string>
+
+namespace ass
+{
+  struct program;
+}
+
+/**
+ * On-disk container for assembled programs.
+ *
+ * All fields are little endian.
+ *
+ *   header     64 bytes   magic "HXBC", version, flags and the position and size of every section,
+ *                          followed by a CRC-32 of everything after the header
+ *   code                  the program blob, exactly as the vm executes it
+ *   symbols    16 bytes   per symbol: name offset, name size, byte offset into the code, symbol_type
+ *   strings               the symbol names, back to back
+ *
+ * The code section starts right after the header, so a mapped file can be executed in place.
+ */
+enum class bytecode_error : std::int_fast8_t
+{
+  None,
+  CannotOpen,
+  Truncated,
+  BadMagic,
+  UnsupportedVersion,
+  BadSection,
+  ChecksumMismatch,
+};
+
+std::string_view bytecode_error_to_str(bytecode_error err);
+
+constexpr std::uint16_t bytecode_version = 1;
+
+// Serializes `code` and `symbols` into the container format.
+std::vector<unsigned char> emit_bytecode(bytecode_view code, const std::vector<ass::symbol_entry>& symbols);
+std::vector<unsigned char> emit_bytecode(const ass::program& prog);
+
+bool write_bytecode(const std::vector<unsigned char>& file, const std::string& path);
+
+class bytecode_file : public std::enable_shared_from_this<bytecode_file>
+{
+public:
+  // Maps the file at `path` read-only. Returns nullptr and sets `error` if it isn't a valid bytecode file.
+  // The checksum covers the whole file, skip it if startup time matters more than detecting corruption.
+  static std::shared_ptr<const bytecode_file> open(const std::string& path, bytecode_error& error,
+                                                   bool check_checksum = true);
+
+  ~bytecode_file();
+
+  bytecode_file(const bytecode_file&) = delete;
+  bytecode_file& operator=(const bytecode_file&) = delete;
+
+  bytecode_view code() const;
+
+  // names point into the mapping
+  const std::vector<ass::symbol_entry>& symbols() const;
+
+  // A program that executes straight from the mapping and keeps it alive.
+  std::shared_ptr<const vm_program> load(bool predecode = false) const;
+private:
+  bytecode_file();
+
+  bytecode_error parse(bool check_checksum);
+private:
+  const unsigned char* mapping;
+  std::size_t mapping_size;
+
+  std::vector<unsigned char> fallback; // file contents where mmap isn't available
+
+  bytecode_view code_section;
+  std::vector<ass::symbol_entry> syms;
+};
+
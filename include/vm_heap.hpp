@@ -0,0 +1,70 @@
+#pragma once
+
+#include <arena.hpp>
+
+#include <cstdint>
+#include <cstddef>
+#include <vector>
+#include <memory>
+
+/**
+ * Heap of the vm, a bump allocator over fixed-size chunks.
+ *
+ * Chunks come from a monotonic_buffer and are never moved or resized, growing the heap only
+ *  ever adds chunks. Allocations larger than a chunk get a block of their own.
+ *
+ * Addresses are what programs see: the upper bits select a slot, which points to a chunk or
+ *  into a large block, the lower bits are the offset into it. Slot 0 is never backed by memory,
+ *  so address 0 can serve as null.
+ */
+class vm_heap
+{
+public:
+  using address = std::uint64_t;
+
+  static constexpr std::size_t chunk_bits = 16;
+  static constexpr std::size_t chunk_size = std::size_t(1) << chunk_bits;
+  static constexpr std::size_t alignment = 8;
+public:
+  // Reserves at least `initial_size` bytes of chunks upfront.
+  explicit vm_heap(std::size_t initial_size = chunk_size);
+
+  // Returns the address of `size` zeroed bytes or 0 if there is no memory left.
+  address allocate(std::size_t size);
+
+  // Returns the memory of `width` bytes starting at `addr` or nullptr if they aren't all backed by one chunk or block.
+  unsigned char* translate(address addr, std::size_t width)
+  {
+    const std::size_t slot = addr >> chunk_bits;
+    const std::size_t offset = addr & (chunk_size - 1);
+
+    if(slot >= slots.size() || offset + width > slots[slot].limit)
+      return nullptr;
+    return slots[slot].base + offset;
+  }
+
+  // Drops all allocations, chunks are kept for reuse.
+  void reset();
+
+  // number of bytes handed out by allocate, including alignment
+  std::size_t allocated() const;
+private:
+  struct alignas(alignment) chunk
+  { unsigned char bytes[chunk_size]; };
+
+  struct slot
+  {
+    unsigned char* base;
+    std::size_t limit;    // number of bytes backed by memory from `base` on
+  };
+private:
+  monotonic_buffer<chunk> chunks;
+  std::vector<chunk*> used_chunks;
+  std::vector<std::unique_ptr<unsigned char[]>> large_blocks;
+
+  std::vector<slot> slots;
+  std::size_t current;    // slot of the chunk that is being bumped into, 0 if none
+  std::size_t bump;
+  std::size_t allocated_bytes;
+};
+
@@ -0,0 +1,64 @@
+#pragma once
+
+#include <vm_opcodes.hpp>
+
+#include <cstdint>
+#include <vector>
+
+// Machine code templates only exist for x86-64 using the System V calling convention.
+#if defined(H_LANG_VM_JIT) && defined(__x86_64__) && defined(__linux__)
+#define H_LANG_VM_HAS_JIT 1
+#else
+#define H_LANG_VM_HAS_JIT 0
+#endif
+
+/**
+ * Basic block template JIT for the vm.
+ *
+ * Once a block entry has been reached `threshold` times, the instructions starting there
+ *  are translated by copying one machine code template per instruction into an executable
+ *  buffer and patching in the operands. The block ends at the first jump or at the first
+ *  instruction without a template, which is left for the interpreter.
+ *
+ * Compiled blocks work directly on the vm's register array and compare flag and
+ *  return the program counter to continue at.
+ * Programs have to pass verify_program, the templates don't check register indices.
+ */
+class vm_jit
+{
+public:
+  using block_fn = std::uint32_t (*)(std::int_fast32_t* regs, bool* compare_flag);
+
+  static constexpr std::size_t default_threshold = 64;
+public:
+  vm_jit(std::size_t threshold = default_threshold, std::size_t code_size = 1 << 20);
+  ~vm_jit();
+
+  vm_jit(const vm_jit&) = delete;
+  vm_jit& operator=(const vm_jit&) = delete;
+
+  // drops all compiled blocks
+  void reset(std::size_t program_size);
+
+  // Returns the compiled block for `pc` or nullptr if it isn't (yet) hot.
+  block_fn enter(bytecode_view program, std::size_t pc);
+
+  // whether the interpreter has to pick up after this instruction
+  static bool ends_block(op_code op);
+
+  std::size_t compiled_blocks() const;
+  void set_threshold(std::size_t threshold);
+private:
+  block_fn compile(bytecode_view program, std::size_t pc);
+private:
+  std::size_t threshold;
+
+  unsigned char* code;
+  std::size_t code_size;
+  std::size_t code_used;
+
+  std::vector<block_fn> blocks;
+  std::vector<std::uint32_t> counters;
+  std::size_t block_count;
+};
+
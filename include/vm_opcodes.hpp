@@ -1,6 +1,10 @@
 #pragma once
 
 #include <cstdint>
+#include <cstddef>
+#include <array>
+#include <string_view>
+#include <vector>
 
 enum class op_code : std::int_fast8_t
 {
@@ -24,15 +28,183 @@ enum class op_code : std::int_fast8_t
   DEC            = 17,
   SHIFT_LEFT     = 18,
   SHIFT_RIGHT    = 19,
+
+  // superinstructions, only ever produced by the assembler
+  LOAD_LOAD_ADD     = 20,
+  EQUAL_JMP_CMP     = 21,
+  INC_LESS_JMP_CMP  = 22,
+
+  // heap access, see vm_heap
+  LOADM          = 23,
+  STOREM         = 24,
   UNKNOWN        
 };
 
+// Non-owning view of a program blob, which lives either in a vm_program or in a mapped bytecode file.
+struct bytecode_view
+{
+public:
+  bytecode_view() = default;
+  bytecode_view(const unsigned char* data, std::size_t size) : ptr(data), len(size)
+  {  }
+  bytecode_view(const std::vector<unsigned char>& v) : ptr(v.data()), len(v.size())
+  {  }
+
+  const unsigned char* data() const { return ptr; }
+  std::size_t size() const { return len; }
+  bool empty() const { return len == 0; }
+
+  const unsigned char* begin() const { return ptr; }
+  const unsigned char* end() const { return ptr + len; }
+
+  unsigned char operator[](std::size_t i) const { return ptr[i]; }
+private:
+  const unsigned char* ptr { nullptr };
+  std::size_t len { 0 };
+};
+
 constexpr op_code byte_to_opcode(unsigned char byte)
 { return static_cast<op_code>(byte); }
 
 constexpr unsigned char opcode_to_byte(op_code byte)
 { return static_cast<unsigned char>(byte); }
 
+// A superinstruction replaces the opcode of the first instruction of a common sequence.
+// The rest of the sequence stays in place, so byte offsets and jump targets don't change
+//  and jumping into the middle of the sequence still executes the original instructions.
+struct superinstruction
+{
+  op_code fused;
+  std::size_t count;
+  std::array<op_code, 3> sequence;
+};
+
+constexpr std::array<superinstruction, 3> superinstructions = {{
+  { op_code::LOAD_LOAD_ADD,    3, { op_code::LOAD, op_code::LOAD, op_code::ADD } },
+  { op_code::INC_LESS_JMP_CMP, 3, { op_code::INC, op_code::LESS, op_code::JMP_CMP } },
+  { op_code::EQUAL_JMP_CMP,    2, { op_code::EQUAL, op_code::JMP_CMP } },
+}};
+
+constexpr const superinstruction* find_superinstruction(op_code op)
+{
+  for(auto& s : superinstructions)
+    if(s.fused == op)
+      return &s;
+  return nullptr;
+}
+
+// assembler mnemonic of an opcode
+constexpr std::string_view opcode_to_str(op_code op)
+{
+  switch(op)
+  {
+  default:                      return "unknown";
+  case op_code::HALT:           return "halt";
+  case op_code::LOAD:           return "load";
+  case op_code::ADD:            return "add";
+  case op_code::SUB:            return "sub";
+  case op_code::MUL:            return "mul";
+  case op_code::DIV:            return "div";
+  case op_code::JMP:            return "jmp";
+  case op_code::JMPREL:         return "jrp";
+  case op_code::JMP_CMP:        return "jcmp";
+  case op_code::JMP_NCMP:       return "jncmp";
+  case op_code::EQUAL:          return "eq";
+  case op_code::GREATER:        return "gt";
+  case op_code::LESS:           return "lt";
+  case op_code::GREATER_EQUAL:  return "ge";
+  case op_code::LESS_EQUAL:     return "le";
+  case op_code::ALLOC:          return "aloc";
+  case op_code::INC:            return "inc";
+  case op_code::DEC:            return "dec";
+  case op_code::SHIFT_LEFT:     return "shl";
+  case op_code::SHIFT_RIGHT:    return "shr";
+
+  case op_code::LOAD_LOAD_ADD:    return "load_load_add";
+  case op_code::EQUAL_JMP_CMP:    return "eq_jcmp";
+  case op_code::INC_LESS_JMP_CMP: return "inc_lt_jcmp";
+
+  case op_code::LOADM:          return "loadm";
+  case op_code::STOREM:         return "storem";
+  }
+}
+
+// number of bytes an instruction occupies in a program blob, including the opcode itself
+// superinstructions only cover their first instruction
+constexpr std::size_t instruction_length(op_code op)
+{
+  if(const auto* fused = find_superinstruction(op))
+    return instruction_length(fused->sequence.front());
+
+  switch(op)
+  {
+  default:
+  case op_code::HALT:          return 1;
+
+  case op_code::JMP:
+  case op_code::JMPREL:
+  case op_code::JMP_CMP:
+  case op_code::JMP_NCMP:
+  case op_code::ALLOC:
+  case op_code::INC:
+  case op_code::DEC:           return 2;
+
+  case op_code::EQUAL:
+  case op_code::GREATER:
+  case op_code::LESS:
+  case op_code::GREATER_EQUAL:
+  case op_code::LESS_EQUAL:
+  case op_code::SHIFT_LEFT:
+  case op_code::SHIFT_RIGHT:
+  case op_code::LOADM:
+  case op_code::STOREM:        return 3;
+
+  case op_code::LOAD:
+  case op_code::ADD:
+  case op_code::SUB:
+  case op_code::MUL:
+  case op_code::DIV:           return 4;
+  }
+}
+
+// number of leading operands that name a register
+constexpr std::size_t register_operands(op_code op)
+{
+  if(const auto* fused = find_superinstruction(op))
+    return register_operands(fused->sequence.front());
+
+  switch(op)
+  {
+  default:
+  case op_code::HALT:
+  case op_code::JMPREL:
+  case op_code::JMP_CMP:
+  case op_code::JMP_NCMP:      return 0;
+
+  // the operands of add, sub and mul are immediates, only div reads registers
+  case op_code::ADD:
+  case op_code::SUB:
+  case op_code::MUL:
+  case op_code::LOAD:
+  case op_code::JMP:
+  case op_code::ALLOC:
+  case op_code::INC:
+  case op_code::DEC:
+  case op_code::SHIFT_LEFT:
+  case op_code::SHIFT_RIGHT:   return 1;
+
+  case op_code::EQUAL:
+  case op_code::GREATER:
+  case op_code::LESS:
+  case op_code::GREATER_EQUAL:
+  case op_code::LESS_EQUAL:
+  case op_code::LOADM:
+  case op_code::STOREM:        return 2;
+
+  case op_code::DIV:           return 3;
+  }
+}
+
 
 struct instruction
 {
@@ -0,0 +1,37 @@
+#pragma once
+
+#include <vm.hpp>
+
+#include <memory>
+#include <vector>
+#include <array>
+
+/**
+ * Runs one program against many independent inputs in parallel.
+ *
+ * Every worker thread owns a vm, i.e. its own registers and heap, while all of them share
+ *  the same immutable vm_program. The inputs are split into one contiguous range per worker.
+ *  A worker that is done with its range steals the back half of what is left of another one.
+ */
+class vm_pool
+{
+public:
+  using register_file = std::array<std::int_fast32_t, vm::register_count>;
+public:
+  // A `threads` count of zero uses one thread per hardware thread.
+  explicit vm_pool(std::shared_ptr<const vm_program> program, std::size_t threads = 0,
+                   vm_dispatch dispatch = vm::default_dispatch, std::size_t heap_size = 256 * 256);
+
+  // Runs the program once per input, each time on a reset vm whose registers are set to the input.
+  // Returns the final registers in the order of the inputs.
+  std::vector<register_file> run(const std::vector<register_file>& inputs) const;
+
+  std::size_t thread_count() const;
+private:
+  std::shared_ptr<const vm_program> program;
+
+  std::size_t threads;
+  vm_dispatch dispatch;
+  std::size_t heap_size;
+};
+
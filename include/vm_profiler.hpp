@@ -0,0 +1,103 @@
+#pragma once
+
+#include <vm_opcodes.hpp>
+
+#include <cstdint>
+#include <vector>
+#include <array>
+#include <algorithm>
+
+#if defined(__x86_64__) || defined(__i386__)
+#include <x86intrin.h>
+#define H_LANG_VM_HAS_TSC 1
+#else
+#define H_LANG_VM_HAS_TSC 0
+#endif
+
+/**
+ * Profiling policies for the dispatch loops of the vm.
+ *
+ * A loop calls `step` right before it executes the instruction at `pc`.
+ * vm_no_profiling is what the regular loops are instantiated with, its empty
+ *  step is inlined away, so profiling costs nothing unless it's asked for.
+ */
+struct vm_no_profiling
+{
+  void step(std::size_t pc, op_code op)
+  {  }
+};
+
+class vm_profile
+{
+public:
+  static constexpr std::size_t opcode_count = opcode_to_byte(op_code::UNKNOWN) + 1;
+
+  struct opcode_stats
+  {
+    std::uint64_t count { 0 };
+
+    // only the sampled executions are timed
+    std::uint64_t samples { 0 };
+    std::uint64_t cycles { 0 };
+  };
+public:
+  // With a `cycle_sample_rate` of n > 0, every n-th instruction is timed with the time stamp counter.
+  // Sampling is a no-op on targets without one.
+  explicit vm_profile(std::size_t cycle_sample_rate = 0);
+
+  void step(std::size_t pc, op_code op)
+  {
+    const std::size_t idx = std::min<std::size_t>(opcode_to_byte(op), opcode_count - 1);
+
+    ++opcodes[idx].count;
+    ++total;
+
+    if(pc >= heat.size())
+      heat.resize(pc + 1, 0);
+    ++heat[pc];
+
+#if H_LANG_VM_HAS_TSC
+    if(cycle_sample_rate == 0)
+      return;
+
+    // a sample spans from the start of one instruction to the start of the next
+    if(sampled != no_sample)
+    {
+      opcodes[sampled].cycles += __rdtsc() - sample_start;
+      ++opcodes[sampled].samples;
+      sampled = no_sample;
+    }
+    if(++since_sample == cycle_sample_rate)
+    {
+      since_sample = 0;
+      sampled = idx;
+      sample_start = __rdtsc();
+    }
+#endif
+  }
+
+  // Closes an open sample, call once the vm stopped.
+  void finish();
+
+  void reset();
+
+  std::uint64_t instructions() const;
+  std::size_t sample_rate() const;
+
+  const opcode_stats& operator[](op_code op) const;
+
+  // execution count per byte offset into the program
+  const std::vector<std::uint64_t>& heat_map() const;
+private:
+  static constexpr std::size_t no_sample = static_cast<std::size_t>(-1);
+
+  std::array<opcode_stats, opcode_count> opcodes;
+  std::vector<std::uint64_t> heat;
+  std::uint64_t total;
+
+  std::size_t cycle_sample_rate;
+  std::size_t since_sample;
+  std::size_t sampled;
+  std::uint64_t sample_start;
+};
+
@@ -0,0 +1,8 @@
+#pragma once
+
+#include <vm_profiler.hpp>
+
+#include <nlohmann/json.hpp>
+
+// kept apart from vm_profiler.hpp, so that users of the vm don't pull in the json library
+void to_json(nlohmann::json& j, const vm_profile& profile);
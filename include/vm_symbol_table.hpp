@@ -1,6 +1,8 @@
 #pragma once
 
 #include <cstdint>
+#include <cstddef>
+#include <string_view>
 
 namespace ass
 {
@@ -8,5 +10,12 @@ namespace ass
   {
     Label
   };
+
+  struct symbol_entry
+  {
+    std::string_view name;
+    symbol_type type;
+    std::size_t offset;
+  };
 }
 
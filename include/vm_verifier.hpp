@@ -0,0 +1,43 @@
+#pragma once
+
+#include <vm_opcodes.hpp>
+
+#include <string_view>
+#include <cstdint>
+#include <vector>
+
+enum class verify_error : std::int_fast8_t
+{
+  None,
+  UnknownOpcode,
+  TruncatedInstruction,
+  InvalidRegister,
+  JumpOutOfProgram,
+  JumpIntoInstruction,
+  MissingHalt,
+  BrokenSuperinstruction,
+};
+
+std::string_view verify_error_to_str(verify_error err);
+
+struct verification
+{
+  verify_error error { verify_error::None };
+  std::size_t offset { 0 }; // byte offset of the offending instruction
+
+  std::vector<bool> instruction_starts;
+
+  explicit operator bool() const
+  { return error == verify_error::None; }
+};
+
+// Checks a program blob once so that it can run without per-instruction checks:
+//  - every opcode is known and all its operands are present
+//  - every register operand is smaller than vm::register_count
+//  - every relative jump lands on an instruction boundary inside the program
+//  - the program can't run off its end, i.e. the last instruction is HALT or a register jump
+//  - every superinstruction is followed by the rest of its sequence
+// Register jumps can only be checked at runtime, against `instruction_starts`.
+verification verify_program(bytecode_view program);
+verification verify_program(const std::vector<unsigned char>& program);
+
@@ -4,8 +4,8 @@
 namespace ass
 {
 
-assembler::assembler(const std::vector<ass::instruction>& v)
-  : prog(v)
+assembler::assembler(std::vector<ass::instruction> v)
+  : prog(std::move(v))
 {  }
 
 program assembler::parse(std::string_view module)
@@ -14,8 +14,9 @@ program assembler::parse(std::string_view module)
 
   assm.phase_one();
   assm.phase_two();
+  assm.phase_three();
 
-  return assm.prog;
+  return std::move(assm.prog);
 }
 
 program assembler::parse_code(const std::string& text)
@@ -24,8 +25,9 @@ program assembler::parse_code(const std::string& text)
 
   assm.phase_one();
   assm.phase_two();
+  assm.phase_three();
 
-  return assm.prog;
+  return std::move(assm.prog);
 }
 
 
@@ -36,19 +38,46 @@ void assembler::phase_one()
   {
     if(i.lab)
     {
-      prog.symbol_table[i.lab->data.get_hash()] = std::make_pair(symbol_type::Label, pos);
+      prog.symbol_table[i.lab->data.get_id()] = std::make_pair(symbol_type::Label, pos);
     }
-    pos += 4ULL;
+    // labels are byte offsets, instructions are 1 to 4 bytes long
+    pos += i.encoded_size();
   }
 }
 
 void assembler::phase_two()
+{ prog.bytes = prog.to_u8_vec(); }
+
+void assembler::phase_three()
 {
-  for(auto& x : prog.instructions)
+  // peephole pass: fuse common instruction sequences into superinstructions.
+  // Only the opcode of the first instruction is replaced, see vm_opcodes.hpp
+  auto& bytes = prog.bytes;
+
+  const auto length_at = [&bytes](std::size_t offset)
+  {
+    const op_code op = byte_to_opcode(bytes[offset]);
+    return opcode_to_byte(op) < opcode_to_byte(op_code::UNKNOWN) ? instruction_length(op) : 1;
+  };
+
+  for(std::size_t offset = 0; offset < bytes.size(); )
   {
-    auto tmp = x.to_u8_vec(prog);
+    std::size_t next = offset + length_at(offset);
+    for(const auto& fused : superinstructions)
+    {
+      std::size_t end = offset;
+      std::size_t i = 0;
+      for(; i < fused.count && end < bytes.size() && byte_to_opcode(bytes[end]) == fused.sequence[i]; ++i)
+        end += instruction_length(fused.sequence[i]);
 
-    std::move(tmp.begin(), tmp.end(), std::back_inserter(prog.bytes));
+      if(i == fused.count && end <= bytes.size())
+      {
+        bytes[offset] = opcode_to_byte(fused.fused);
+        next = end;
+        break;
+      }
+    }
+    offset = next;
   }
 }
 
@@ -22,14 +22,14 @@ void hx_ast::print(std::ostream& os, ast_ptr node)
   case ASTNodeKind::Prop: os << "Prop"; break;
   case ASTNodeKind::unit: os << "()"; break;
   case ASTNodeKind::assign: {
-      assign::ptr as = std::static_pointer_cast<assign>(node);
+      assign::ptr as = static_cast<assign*>(node);
       print(os, as->lhs);
       os << " = ";
       print(os, as->rhs);
       os << ";";
     } break;
   case ASTNodeKind::assign_data: {
-      assign_data::ptr as = std::static_pointer_cast<assign_data>(node);
+      assign_data::ptr as = static_cast<assign_data*>(node);
       os << "data ";
       print(os, as->lhs);
       os << " : ";
@@ -37,7 +37,7 @@ void hx_ast::print(std::ostream& os, ast_ptr node)
       os << ";";
     } break;
   case ASTNodeKind::assign_type: {
-      assign_type::ptr as = std::static_pointer_cast<assign_type>(node);
+      assign_type::ptr as = static_cast<assign_type*>(node);
       os << "type ";
       print(os, as->lhs);
       os << " : ";
@@ -45,16 +45,16 @@ void hx_ast::print(std::ostream& os, ast_ptr node)
       os << ";";
     } break;
   case ASTNodeKind::expr_stmt:   {
-      expr_stmt::ptr ex = std::static_pointer_cast<expr_stmt>(node);
+      expr_stmt::ptr ex = static_cast<expr_stmt*>(node);
       print(os, ex->lhs);
       os << ";";
     } break;
   case ASTNodeKind::identifier:  {
-      identifier::ptr id = std::static_pointer_cast<identifier>(node);
+      identifier::ptr id = static_cast<identifier*>(node);
       os << id->symb.get_string();
     } break;
   case ASTNodeKind::lambda:      {
-      lambda::ptr lam = std::static_pointer_cast<lambda>(node);
+      lambda::ptr lam = static_cast<lambda*>(node);
 
       if(lam->lhs->annot != nullptr && !hx_ast::used(lam->lhs, lam->rhs))
       {
@@ -73,7 +73,7 @@ void hx_ast::print(std::ostream& os, ast_ptr node)
       }
     } break;
   case ASTNodeKind::app:         {
-      app::ptr ap = std::static_pointer_cast<app>(node);
+      app::ptr ap = static_cast<app*>(node);
       os << "((";
       print(os, ap->lhs);
       os << ") (";
@@ -81,14 +81,14 @@ void hx_ast::print(std::ostream& os, ast_ptr node)
       os << "))";
     } break;                                  
   case ASTNodeKind::match: {
-      match::ptr mm = std::static_pointer_cast<match>(node);
+      match::ptr mm = static_cast<match*>(node);
       
       print(os, mm->pat);
       os << " => ";
       print(os, mm->exp);
     } break;
   case ASTNodeKind::pattern_matcher: {
-      pattern_matcher::ptr pm = std::static_pointer_cast<pattern_matcher>(node);
+      pattern_matcher::ptr pm = static_cast<pattern_matcher*>(node);
 
       os << "case (";
       print(os, pm->to_match);
@@ -128,37 +128,37 @@ bool hx_ast::used(ast_ptr what, ast_ptr in, tsl::robin_set<identifier::ptr>& bin
   case ASTNodeKind::Prop: ret = what->kind == ASTNodeKind::Prop; break;
   case ASTNodeKind::unit: ret = what->kind == ASTNodeKind::unit; break;
   case ASTNodeKind::assign: {
-      assign::ptr as = std::static_pointer_cast<assign>(in);
+      assign::ptr as = static_cast<assign*>(in);
 
-      auto itp = binders.insert(std::static_pointer_cast<identifier>(as->lhs));
+      auto itp = binders.insert(static_cast<identifier*>(as->lhs));
       assert(itp.second && "Binder already inserted before.");
       if(used(what, as->rhs, binders))
         ret = true;
     } break;
   case ASTNodeKind::assign_data: {
-      assign_data::ptr as = std::static_pointer_cast<assign_data>(in);
+      assign_data::ptr as = static_cast<assign_data*>(in);
 
       if(used(what, as->rhs, binders))
         ret = true;
-      auto itp = binders.insert(std::static_pointer_cast<identifier>(as->lhs));
+      auto itp = binders.insert(static_cast<identifier*>(as->lhs));
       assert(itp.second && "Binder already inserted before.");
     } break;
   case ASTNodeKind::assign_type: {
-      assign_type::ptr as = std::static_pointer_cast<assign_type>(in);
+      assign_type::ptr as = static_cast<assign_type*>(in);
 
-      auto itp = binders.insert(std::static_pointer_cast<identifier>(as->lhs));
+      auto itp = binders.insert(static_cast<identifier*>(as->lhs));
       assert(itp.second && "Binder already inserted before.");
       if(used(what, as->rhs, binders))
         ret = true;
     } break;
   case ASTNodeKind::expr_stmt:   {
-      expr_stmt::ptr ex = std::static_pointer_cast<expr_stmt>(in);
+      expr_stmt::ptr ex = static_cast<expr_stmt*>(in);
 
       if(used(what, ex->lhs, binders))
         ret = true;
     } break;
   case ASTNodeKind::identifier:  {
-      identifier::ptr id = std::static_pointer_cast<identifier>(in);
+      identifier::ptr id = static_cast<identifier*>(in);
 
       if(id->symb == symbol("_"))
         return false;  // always just ignore the underscore
@@ -167,17 +167,17 @@ bool hx_ast::used(ast_ptr what, ast_ptr in, tsl::robin_set<identifier::ptr>& bin
         ret = false;
       else
       {
-        identifier::ptr whatid = std::static_pointer_cast<identifier>(what);
+        identifier::ptr whatid = static_cast<identifier*>(what);
 
         // Variable is only used if the context hasn't seen its binder before
-        ret = whatid->symb == id->symb && !binders.contains(std::static_pointer_cast<identifier>(id));
+        ret = whatid->symb == id->symb && !binders.contains(static_cast<identifier*>(id));
       }
     } break;
   case ASTNodeKind::lambda:      {
-      lambda::ptr lam = std::static_pointer_cast<lambda>(in);
+      lambda::ptr lam = static_cast<lambda*>(in);
       assert(lam->lhs->kind == ASTNodeKind::identifier && "Bug in parser.");
 
-      auto itp = binders.insert(std::static_pointer_cast<identifier>(lam->lhs));
+      auto itp = binders.insert(static_cast<identifier*>(lam->lhs));
       assert(itp.second && "Insertion must succeed, we can't have \"\\x. \\x. x\"");
       
       if(used(what, lam->rhs, binders))
@@ -185,14 +185,14 @@ bool hx_ast::used(ast_ptr what, ast_ptr in, tsl::robin_set<identifier::ptr>& bin
       else
       {
         assert(!binders.empty());
-        binders.erase(binders.find(std::static_pointer_cast<identifier>(lam->lhs)));
+        binders.erase(binders.find(static_cast<identifier*>(lam->lhs)));
 
         if(lam->lhs->annot)
           ret = used(what, lam->lhs->annot, binders);
       }
     } break;
   case ASTNodeKind::app:         {
-      app::ptr ap = std::static_pointer_cast<app>(in);
+      app::ptr ap = static_cast<app*>(in);
 
       if(used(what, ap->lhs, binders))
         ret = true;
@@ -200,7 +200,7 @@ bool hx_ast::used(ast_ptr what, ast_ptr in, tsl::robin_set<identifier::ptr>& bin
         ret = true;
     } break;                                  
   case ASTNodeKind::pattern_matcher: {
-      pattern_matcher::ptr pm = std::static_pointer_cast<pattern_matcher>(in);
+      pattern_matcher::ptr pm = static_cast<pattern_matcher*>(in);
 
       if(used(what, pm->to_match))
         ret = true;
@@ -217,7 +217,7 @@ bool hx_ast::used(ast_ptr what, ast_ptr in, tsl::robin_set<identifier::ptr>& bin
       }
     } break;
   case ASTNodeKind::match: {
-      match::ptr mm = std::static_pointer_cast<match>(in);
+      match::ptr mm = static_cast<match*>(in);
 
       // TODO: FIX. This messes up things, since to_match might bind identifiers
       if(used(what, mm->pat))
@@ -229,22 +229,8 @@ bool hx_ast::used(ast_ptr what, ast_ptr in, tsl::robin_set<identifier::ptr>& bin
   return ret || (in->annot ? used(what, in->annot, binders) : false);
 }
 
-bool hx_ast::type_checks() const
-{
-  hx_ast_type_checking checker(*this);
-  bool type_checks = true;
-
-  typing_context ctx;
-  for(auto& root : data)
-  {
-    auto typ = checker.find_type(ctx, root);
-
-    if(typ == nullptr)
-      type_checks = false;
-  }
-
-  return type_checks;
-}
+bool hx_ast::type_checks(thread_pool* pool) const
+{ return hx_ast_type_checking::check_statements(*this, pool); }
 
 void hx_ast::print_as_type(std::ostream& os, ast_ptr node)
 {
@@ -270,11 +256,11 @@ void hx_ast::print_as_type(std::ostream& os, ast_ptr node)
                           assert(false && "Statements are no types."); break;
 
   case ASTNodeKind::identifier:  {
-      identifier::ptr id = std::static_pointer_cast<identifier>(node);
+      identifier::ptr id = static_cast<identifier*>(node);
       os << id->symb.get_string();
     } break;
   case ASTNodeKind::lambda:      {
-      lambda::ptr lam = std::static_pointer_cast<lambda>(node);
+      lambda::ptr lam = static_cast<lambda*>(node);
 
       if(lam->lhs->type != nullptr && !hx_ast::used(lam->lhs, lam->rhs))
       {
@@ -293,7 +279,7 @@ void hx_ast::print_as_type(std::ostream& os, ast_ptr node)
       }
     } break;
   case ASTNodeKind::app:         {
-      app::ptr ap = std::static_pointer_cast<app>(node);
+      app::ptr ap = static_cast<app*>(node);
       os << "((";
       print_as_type(os, ap->lhs);
       os << ") (";
@@ -301,14 +287,14 @@ void hx_ast::print_as_type(std::ostream& os, ast_ptr node)
       os << "))";
     } break;                                  
   case ASTNodeKind::match: {
-      match::ptr mm = std::static_pointer_cast<match>(node);
+      match::ptr mm = static_cast<match*>(node);
       
       print_as_type(os, mm->pat);
       os << " => ";
       print_as_type(os, mm->exp);
     } break;
   case ASTNodeKind::pattern_matcher: {
-      pattern_matcher::ptr pm = std::static_pointer_cast<pattern_matcher>(node);
+      pattern_matcher::ptr pm = static_cast<pattern_matcher*>(node);
 
       os << "case (";
       print_as_type(os, pm->to_match);
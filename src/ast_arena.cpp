@@ -0,0 +1,35 @@
+#include <ast_arena.hpp>
+
+#include <algorithm>
+
+ast_arena::~ast_arena()
+{
+  for(auto it = destructors.rbegin(); it != destructors.rend(); ++it)
+    it->second(it->first);
+}
+
+ast_arena::ast_arena(ast_arena&& other)
+  : blocks(std::move(other.blocks)), cur(std::exchange(other.cur, nullptr)),
+    end(std::exchange(other.end, nullptr)),
+    next_block_size(std::exchange(other.next_block_size, first_block_size)),
+    used(std::exchange(other.used, 0)), destructors(std::move(other.destructors))
+{
+  other.blocks.clear();
+  other.destructors.clear();
+}
+
+std::size_t ast_arena::size() const
+{ return used; }
+
+void* ast_arena::allocate_block(std::size_t size, std::size_t align)
+{
+  // new[] only aligns to the fundamental alignment, leave room for more
+  const std::size_t block_size = std::max(next_block_size, size + align);
+  next_block_size = block_size * 2;
+
+  blocks.emplace_back(new char[block_size]);
+  cur = blocks.back().get();
+  end = cur + block_size;
+
+  return allocate(size, align);
+}
@@ -6,8 +6,6 @@
 
 #include <iostream>
 #include <sstream>
-#include <future>
-#include <thread>
 #include <cstdio>
 #include <string>
 #include <vector>
@@ -57,7 +55,7 @@ static const std::map<emit_classes, std::function<void(std::string_view)>> emitt
         return; // <- diagnostic will contain an error
       auto& global_ir = w.back();
 
-      if(!global_ir.type_checks())
+      if(!global_ir.type_checks(thread_pool::current()))
         std::cout << "~~~> Does not typecheck. <~~~\n";
       else
         std::cout << "~~~> Does typecheck. <~~~\n";
@@ -74,6 +72,10 @@ static const std::map<emit_classes, std::function<void(std::string_view)>> emitt
     } },
 };
 
+compiler::compiler()
+  : pool(config.num_cores)
+{  }
+
 void compiler::go()
 {
   std::vector<std::string_view> tasks;
@@ -82,31 +84,9 @@ void compiler::go()
   else
     tasks = config.files;
 
-  std::vector<std::future<void>> runners;
-  for(auto tit = tasks.begin(); tit != tasks.end(); )
-  {
-    for(std::size_t i = runners.size(); tit != tasks.end() && i < config.num_cores; ++i)
-    {
-      auto& t = *tit;
-
-      runners.emplace_back(std::async(std::launch::async, [t]() { emitter.at(config.emit_class)(t); }));
+  for(auto& t : tasks)
+    pool.submit([t]() { emitter.at(config.emit_class)(t); });
 
-      ++tit;
-    }
-    for(auto rit = runners.begin(); rit != runners.end(); )
-    {
-      assert(rit->valid() && "Future has become invalid!");
-      if(rit->wait_for(std::chrono::nanoseconds(100)) == std::future_status::ready)
-        rit = runners.erase(rit);
-      else
-        ++rit;
-    }
-  }
-  for(auto rit = runners.begin(); rit != runners.end(); )
-  {
-    assert(rit->valid() && "Future has become invalid!");
-    rit->wait();
-    rit = runners.erase(rit);
-  }
+  pool.wait();
 }
 
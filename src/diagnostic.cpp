@@ -6,6 +6,48 @@
 
 #include <algorithm>
 #include <cassert>
+#include <utility>
+
+namespace
+{
+
+// installed by diagnostics_manager::capture
+thread_local std::vector<json::json>* captured = nullptr;
+
+// Walks the lines of a source like std::getline on a stream, without copying them.
+class line_cursor
+{
+public:
+  explicit line_cursor(std::string_view text)
+    : text(text), pos(0), at_end(false)
+  {  }
+
+  // false once a line ran into the end of the text
+  bool good() const
+  { return !at_end; }
+
+  std::string_view getline()
+  {
+    const std::size_t nl = text.find('\n', pos);
+    if(nl == std::string_view::npos)
+    {
+      at_end = true;
+      return text.substr(std::min(pos, text.size()));
+    }
+    const std::string_view line = text.substr(pos, nl - pos);
+    pos = nl + 1;
+    return line;
+  }
+
+  void ignore()
+  { getline(); }
+private:
+  std::string_view text;
+  std::size_t pos;
+  bool at_end;
+};
+
+}
 
 namespace mk_diag
 {
@@ -54,8 +96,17 @@ json::json fixit(const source_range& range, const fixit_info& info)
 
 }
 
+std::vector<json::json>* diagnostics_manager::capture(std::vector<json::json>* buffer)
+{ return std::exchange(captured, buffer); }
+
 diagnostics_manager& diagnostics_manager::operator<<=(const json::json& msg)
 {
+  if(captured != nullptr)
+  {
+    captured->push_back(msg);
+    return *this;
+  }
+
   std::lock_guard<std::mutex> guard(mut);
 
   if(msg["level"].get<diag_level>() == diag_level::error)
@@ -113,29 +164,31 @@ void diagnostics_manager::print(std::FILE* file)
           // TODO: can be made faster by doing only one pass over the code for *all* messages instead of for every
           auto info = v["fixit"].get<fixit_info>();
 
-          auto& ifile = stream_lookup[v["range"]["module"].get<std::string_view>()];
+          const auto module = v["range"]["module"].get<std::string_view>();
+          const auto source = stream_lookup[module];
+          line_cursor ifile(source->text());
 
           std::sort(info.changes.begin(), info.changes.end(), [](auto& lhs, auto& rhs) { return lhs.first < rhs.first; });
           auto correction = info.changes.begin();
 
-          std::size_t row = 0;
+          // rows before the start of the stream are gone, like the early lines of stdin
+          std::size_t row = stream_lookup.first_row(module) - 1;
 
-          // move file pointer to line right before the first line we need to perform std::getline at
-          ifile.seekg(std::ios::beg);
+          // move to the line right before the first line we need to fetch
           if(row < correction->first.row)
           {
             for(; row + 1 < correction->first.row - 1; ++row){
-              ifile.ignore(std::numeric_limits<std::streamsize>::max(),'\n');
+              ifile.ignore();
             }
           }
           std::size_t already_printed_col = 0;
-          std::string buf;
+          std::string_view buf;
           while(correction != info.changes.end())
           {
             // fetch line. Doesn't change if two corrections are on the same row
             while(row < correction->first.row - 1 && ifile.good())
             {
-              std::getline(ifile, buf);
+              buf = ifile.getline();
               row++;
               already_printed_col = 0;
 
@@ -184,8 +237,6 @@ void diagnostics_manager::print(std::FILE* file)
 
             ++correction;
           }
-
-          stream_lookup.drop(v["range"]["module"].get<std::string_view>());
         } break;
       }
       fmt::print(file, fg(fmt::color::white), "\n");
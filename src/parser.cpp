@@ -4,7 +4,6 @@
 
 #include <tsl/robin_map.h>
 
-#include <sstream>
 
 const ast_ptr hx_reader::error_ref = nullptr;
 
@@ -72,7 +71,7 @@ ast_ptr hx_reader::parse_identifier()
     if(id == symbol("_"))
     {
       // Do not reference
-      return std::make_shared<identifier>(id);
+      return arena->make<identifier>(id);
     }
     else
     {
@@ -82,7 +81,7 @@ ast_ptr hx_reader::parse_identifier()
   }
   else
   {
-    auto to_ret = std::make_shared<identifier>(id); // <- free variable
+    auto to_ret = arena->make<identifier>(id); // <- free variable
     if(scoping_ctx.is_binding)
       scoping_ctx.binder_stack.emplace_back(id, to_ret);
     return to_ret;
@@ -96,7 +95,7 @@ ast_ptr hx_reader::parse_app(ast_ptr lhs)
   if(rhs == error_ref)
     return error_ref;
 
-  return std::make_shared<app>(lhs, rhs);
+  return arena->make<app>(lhs, rhs);
 }
 
 // e := `\\` id `.` e       id can be _ to simply ignore the argument. Note that `\\` is a single backslash
@@ -120,9 +119,9 @@ ast_ptr hx_reader::parse_lambda()
     // No scoping, the argument implicitly is "_" so there is nothing to bind!
     auto expr = parse_expression();
 
-    auto id = std::make_shared<identifier>("_");
+    auto id = arena->make<identifier>("_");
     id->annot = param;
-    return std::make_shared<lambda>(id, expr);
+    return arena->make<lambda>(id, expr);
   }
   // We require a lambda
   auto lam_tok = current;
@@ -173,7 +172,7 @@ ast_ptr hx_reader::parse_lambda()
   lam_tok.loc += old.loc;
 // TODO:  global_scope.dbg_data[to_ret].loc = lam_tok;
 
-  return std::make_shared<lambda>(param, expr);
+  return arena->make<lambda>(param, expr);
 }
 
 // e := Kind
@@ -181,7 +180,7 @@ ast_ptr hx_reader::parse_Kind()
 {
   if(!expect(token_kind::Keyword, diagnostic_db::parser::expected_keyword_Kind))
     return mk_error();
-  return std::make_shared<kind>();
+  return arena->make<kind>();
 }
 
 // e := Type
@@ -189,7 +188,7 @@ ast_ptr hx_reader::parse_Type()
 {
   if(!expect(token_kind::Keyword, diagnostic_db::parser::expected_keyword_Type))
     return mk_error();
-  return std::make_shared<type>();
+  return arena->make<type>();
 }
 
 // e := Prop
@@ -197,7 +196,7 @@ ast_ptr hx_reader::parse_Prop()
 {
   if(!expect(token_kind::Keyword, diagnostic_db::parser::expected_keyword_Prop))
     return mk_error();
-  return std::make_shared<prop>();
+  return arena->make<prop>();
 }
 
 // s := `data` name ( `(` id `:` type `)` )* `:` type `;`
@@ -221,7 +220,7 @@ ast_ptr hx_reader::parse_data_ctor()
   scoping_ctx.binder_stack.emplace_back(type_name_id, type_name);
   
   type_name->annot = tail;
-  return std::make_shared<assign_data>(type_name, tail);
+  return arena->make<assign_data>(type_name, tail);
 }
 
 // s := `type` name ( `(` id `:` type `)` )* `:` Sort `;`
@@ -246,7 +245,7 @@ ast_ptr hx_reader::parse_type_ctor()
   scoping_ctx.binder_stack.emplace_back(type_name_id, type_name);
 
   type_name->annot = tail;
-  return std::make_shared<assign_type>(type_name, tail);
+  return arena->make<assign_type>(type_name, tail);
 }
 
 
@@ -275,7 +274,7 @@ ast_ptr hx_reader::parse_assign()
 
     return mk_error();
   }
-  auto ass = std::make_shared<assign>(var, arg);
+  auto ass = arena->make<assign>(var, arg);
   ass->lhs->annot = arg->annot;
 
   return ass;
@@ -300,16 +299,16 @@ ast_ptr hx_reader::parse_expr_stmt()
     return mk_error();
   }
   //TODO: fix data
-  return std::make_shared<expr_stmt>(expr);
+  return arena->make<expr_stmt>(expr);
 }
 
 ast_ptr hx_reader::parse_statement()
 {
   ast_ptr to_ret = nullptr;
   fixits_stack.emplace_back();
-  if(current.kind == token_kind::Keyword && current.data.get_hash() == symbol("type").get_hash())
+  if(current.kind == token_kind::Keyword && current.data == symbol("type"))
     to_ret = parse_type_ctor();
-  else if(current.kind == token_kind::Keyword && current.data.get_hash() == symbol("data").get_hash())
+  else if(current.kind == token_kind::Keyword && current.data == symbol("data"))
     to_ret = parse_data_ctor();
   else if(next_toks[0].kind == token_kind::Equal)
     to_ret = parse_assign();
@@ -322,13 +321,13 @@ ast_ptr hx_reader::parse_statement()
 
 ast_ptr hx_reader::parse_keyword()
 {
-  switch(current.data.get_hash())
-  {
-  case hash_string("Type"): return parse_Type();
-  case hash_string("Kind"): return parse_Kind();
-  case hash_string("Prop"): return parse_Prop();
-  case hash_string("case"): return parse_case();
-  }
+  // ids are handed out at runtime, so they can't be switched over
+  static const symbol Type("Type"), Kind("Kind"), Prop("Prop"), Case("case");
+
+  if(current.data == Type) return parse_Type();
+  if(current.data == Kind) return parse_Kind();
+  if(current.data == Prop) return parse_Prop();
+  if(current.data == Case) return parse_case();
   assert(false && "bug in lexer, we would not see a keyword token otherwise");
   return mk_error();
 }
@@ -360,13 +359,13 @@ ast_ptr hx_reader::parse_case()
 
       auto expr = parse_expression();
 
-      match_arms.emplace_back(std::make_shared<match>(pat, expr));
+      match_arms.emplace_back(arena->make<match>(pat, expr));
     } while(accept('|'));
   }
   if(!expect(']', diagnostic_db::parser::case_expects_rbracket))
     return mk_error();
 
-  return std::make_shared<pattern_matcher>(what_to_match, match_arms);
+  return arena->make<pattern_matcher>(what_to_match, match_arms);
 }
 
 ast_ptr hx_reader::parse_with_parentheses()
@@ -375,7 +374,7 @@ ast_ptr hx_reader::parse_with_parentheses()
     return mk_error();
 
   if(accept(')'))
-    return std::make_shared<unit>();
+    return arena->make<unit>();
 
   if(current.kind == token_kind::Identifier && next_toks[0].kind == token_kind::Colon)
   {
@@ -401,7 +400,7 @@ ast_ptr hx_reader::parse_with_parentheses()
       auto body = parse_expression();
       scoping_ctx.binder_stack.pop_back();
 
-      return std::make_shared<lambda>(id, body);
+      return arena->make<lambda>(id, body);
     }
     // just an identifier with a type annotation
     return id;
@@ -489,9 +488,9 @@ ast_ptr hx_reader::parse_arrow_lam(ast_ptr argument)
 
   auto bdy = parse_expression();
 
-  auto arg = std::make_shared<identifier>("_");
+  auto arg = arena->make<identifier>("_");
   arg->annot = argument;
-  return std::make_shared<lambda>(arg, bdy);
+  return arena->make<lambda>(arg, bdy);
 }
 
 // e
@@ -553,6 +552,7 @@ std::vector<hx_ast> hx_reader::read(std::string_view module)
   r.scoping_ctx = ctx;
 
   hx_ast ast;
+  r.arena = ast.arena.get();
   while(r.current.kind != token_kind::EndOfFile)
   {
     auto stmt = r.parse_statement();
@@ -576,6 +576,7 @@ std::vector<std::pair<hx_ast, scoping_context>> hx_reader::read_with_ctx(std::st
   r.scoping_ctx = ctx;
 
   hx_ast ast;
+  r.arena = ast.arena.get();
   while(r.current.kind != token_kind::EndOfFile)
   {
     auto stmt = r.parse_statement();
@@ -609,12 +610,12 @@ std::vector<token> hx_reader::read(std::string_view module)
 
 std::pair<hx_ast, scoping_context> hx_reader::read_text(const std::string& text, scoping_context&& ctx)
 {
-  std::stringstream ss(text);
-  hx_reader r(ss);
+  hx_reader r(source_file::from_text(text));
 
   r.scoping_ctx = ctx;
 
   hx_ast ast;
+  r.arena = ast.arena.get();
   while(r.current.kind != token_kind::EndOfFile)
   {
     auto stmt = r.parse_statement();
@@ -652,7 +653,7 @@ ass::instruction asm_reader::parse_op(op_code opc)
 {
   auto super_old = current;
 
-  std::vector<ass::token> args;
+  ass::operand_list args;
   switch(current.opc)
   {
   default: // No arg
@@ -680,6 +681,8 @@ ass::instruction asm_reader::parse_op(op_code opc)
   case op_code::LESS_EQUAL:
   case op_code::SHIFT_LEFT:
   case op_code::SHIFT_RIGHT:
+  case op_code::LOADM:
+  case op_code::STOREM:
     {
     consume();
     args.push_back(current);
@@ -713,7 +716,9 @@ ass::instruction asm_reader::parse_directive()
 
 ass::instruction asm_reader::parse_labeldef()
 {
-  return { std::nullopt, current, std::nullopt, {} };
+  ass::instruction label { std::nullopt, current, std::nullopt, {} };
+  consume();
+  return label;
 }
 
 template<>
@@ -751,8 +756,7 @@ std::vector<ass::instruction> asm_reader::read(std::string_view module)
 template<>
 std::vector<ass::instruction> asm_reader::read_text(const std::string& text)
 {
-  std::stringstream ss(text);
-  asm_reader r(ss);
+  asm_reader r(source_file::from_text(text));
 
   std::vector<ass::instruction> instructions;
   while(r.current.kind != ass::token_kind::EndOfFile)
@@ -767,6 +771,10 @@ std::vector<ass::instruction> asm_reader::read_text(const std::string& text)
       {
         instructions.emplace_back(r.parse_op(r.current.opc));
       } break;
+    case ass::token_kind::LabelDef:
+      {
+        instructions.emplace_back(r.parse_labeldef());
+      } break;
     }
   }
   if(instructions.empty() && diagnostic.empty()) // only emit "empty module" if there hasn't been any diagnostic anyway
@@ -8,25 +8,39 @@ namespace ass
 
 std::vector<unsigned char> program::to_u8_vec() const
 {
-  std::vector<unsigned char> v;
-  v.reserve(instructions.size() * 3);
-
+  std::size_t size = 0;
   for(auto& instr : instructions)
-  {
-    const auto& intermediate = instr.to_u8_vec(*this);
+    size += instr.encoded_size();
 
-    std::move(intermediate.begin(), intermediate.end(), std::back_inserter(v));
-  }
+  std::vector<unsigned char> v(size);
 
-  v.shrink_to_fit();
+  unsigned char* out = v.data();
+  for(auto& instr : instructions)
+    out = instr.encode(out, *this);
+
+  assert(out == v.data() + v.size());
   return v;
 }
 
 const std::pair<symbol_type, std::size_t>& program::lookup_symbol(const symbol& name) const
 {
-  auto cit = symbol_table.find(name.get_hash());
+  auto cit = symbol_table.find(name.get_id());
   assert(cit != symbol_table.end());
   return cit->second;
 }
 
+std::vector<symbol_entry> program::symbols() const
+{
+  std::vector<symbol_entry> result;
+  for(auto& instr : instructions)
+  {
+    if(!instr.lab)
+      continue;
+
+    const auto& [type, offset] = lookup_symbol(instr.lab->data);
+    result.push_back({ instr.lab->data.get_string(), type, offset });
+  }
+  return result;
+}
+
 }
@@ -3,6 +3,8 @@
 #include <assembler.hpp>
 #include <diagnostic.hpp>
 #include <type_checking.hpp>
+#include <vm_bytecode.hpp>
+#include <vm_profiler_json.hpp>
 
 #include <fmt/format.h>
 
@@ -10,6 +12,7 @@
 #include <iomanip>
 #include <fstream>
 #include <sstream>
+#include <algorithm>
 
 bool prompt_yes_no()
 {
@@ -72,12 +75,15 @@ namespace hx
 {
   REPL::REPL(std::string_view t) : base_repl()
   {
+    tctx.arena = &terms;
+
     if(t == "STDIN")
       return;
     auto w = hx_reader::read_with_ctx<hx_ast>(t, std::move(sctx));
     sctx = std::move(w.back().second);
 
     auto& global_ir = w.back().first;
+    inputs.push_back(global_ir.arena);
     if(!diagnostic.empty())
     {
       diagnostic.print(stdout);
@@ -87,7 +93,14 @@ namespace hx
     hx_ast_type_checking checker(global_ir);
     for(auto& r : global_ir.data)
     {
+      // a statement that does not check leaves nothing behind in the context
+      auto before = tctx.save();
       auto typ = checker.find_type(tctx, r);
+      if(typ == nullptr)
+        tctx.rollback(before);
+      else
+        tctx.keep(before);
+
       if(!diagnostic.empty())
       {
         diagnostic.print(stdout);
@@ -142,7 +155,7 @@ R"(
     else if(line == "'clear-context")
     {
       sctx.binder_stack.clear();
-      tctx.data.clear();
+      tctx.clear();
     }
     else
     {
@@ -150,6 +163,7 @@ R"(
         return;
       auto [global_ir, new_sctx] = hx_reader::read_text(line, std::move(sctx));
       sctx = std::move(new_sctx);
+      inputs.push_back(global_ir.arena);
 
       if(global_ir.data.empty())
       {
@@ -173,7 +187,13 @@ R"(
         if(r == nullptr)
           continue;
 
+        auto before = tctx.save();
         auto typ = checker.find_type(tctx, r);
+        if(typ == nullptr)
+          tctx.rollback(before);
+        else
+          tctx.keep(before);
+
         if(!diagnostic.empty())
         {
           diagnostic.print(stdout);
@@ -199,7 +219,7 @@ R"(
 
 namespace virt
 {
-  REPL::REPL() : base_repl(), virt_mach()
+  REPL::REPL() : base_repl(), virt_mach(), last_profile(1)
   {  }
 
   void REPL::run_impl()
@@ -253,6 +273,14 @@ namespace virt
       virt_mach.run();
     else if(line == "'next")
       virt_mach.run_next_instr();
+    else if(line == "'profile")
+      profile();
+    else if(line == "'dump-profile")
+      dump_profile();
+    else if(line == "'load-bytecode")
+      load_bytecode();
+    else if(line == "'write-bytecode")
+      write_bytecode();
     else if(line == "'write")
       write();
     else if(line == "'load")
@@ -260,8 +288,7 @@ namespace virt
     else
     {
       auto prog = ass::assembler::parse_code(line);
-
-      const auto& v = prog.to_u8_vec();
+      auto v = prog.get_bytes();
 
       //auto v = parse_hex(line);
 
@@ -273,7 +300,11 @@ namespace virt
           std::cout << "Type \"'quit\" or hit Ctrl-D to quit.\n";
       }
       else
-      { virt_mach.set_program(v); }
+      {
+        labels = prog.symbols();
+        labels_owner.reset();
+        virt_mach.set_program(std::move(v), true);
+      }
     }
     commands.emplace_back(line);
   }
@@ -328,5 +359,112 @@ namespace virt
       ;
     fmt::print("\nState loaded from \"{}\".\n", filepath);
   }
-}
 
+  void REPL::profile()
+  {
+    last_profile.reset();
+    virt_mach.run_profiled(last_profile);
+
+    fmt::print("Executed {} instructions.\n", last_profile.instructions());
+    if(last_profile.instructions() == 0)
+      return;
+
+    std::vector<op_code> ops;
+    for(std::size_t i = 0; i < vm_profile::opcode_count; ++i)
+    {
+      if(last_profile[byte_to_opcode(i)].count != 0)
+        ops.push_back(byte_to_opcode(i));
+    }
+    std::stable_sort(ops.begin(), ops.end(), [this](op_code a, op_code b)
+              { return last_profile[a].count > last_profile[b].count; });
+
+    fmt::print("{:<14} {:>12} {:>7} {:>12}\n", "opcode", "count", "share", "cycles/op");
+    for(auto op : ops)
+    {
+      const auto& stats = last_profile[op];
+      const double share = 100.0 * stats.count / last_profile.instructions();
+
+      if(stats.samples == 0)
+        fmt::print("{:<14} {:>12} {:>6.2f}% {:>12}\n", opcode_to_str(op), stats.count, share, "-");
+      else
+        fmt::print("{:<14} {:>12} {:>6.2f}% {:>12.1f}\n", opcode_to_str(op), stats.count, share,
+                   static_cast<double>(stats.cycles) / stats.samples);
+    }
+
+    // hottest instructions first
+    const auto& heat = last_profile.heat_map();
+
+    std::vector<std::size_t> pcs;
+    for(std::size_t pc = 0; pc < heat.size(); ++pc)
+    {
+      if(heat[pc] != 0)
+        pcs.push_back(pc);
+    }
+    const std::size_t shown = std::min<std::size_t>(pcs.size(), 10);
+    std::partial_sort(pcs.begin(), pcs.begin() + shown, pcs.end(),
+                      [&heat](std::size_t a, std::size_t b) { return heat[a] > heat[b] || (heat[a] == heat[b] && a < b); });
+
+    fmt::print("\n{:>6} {:<14} {:>12}\n", "pc", "opcode", "count");
+    for(std::size_t i = 0; i < shown; ++i)
+    {
+      fmt::print("{:>6} {:<14} {:>12}\n", pcs[i], opcode_to_str(byte_to_opcode(virt_mach.get_program()[pcs[i]])),
+                 heat[pcs[i]]);
+    }
+  }
+
+  void REPL::dump_profile()
+  {
+    fmt::print("File: ");
+
+    std::string filepath;
+    std::getline(std::cin, filepath);
+
+    if(filepath.empty())
+      return;
+
+    std::fstream file(filepath, std::ios::out);
+    file << nlohmann::json(last_profile).dump(2) << "\n";
+
+    fmt::print("\nProfile written to \"{}\".\n", filepath);
+  }
+
+  void REPL::load_bytecode()
+  {
+    fmt::print("File: ");
+
+    std::string filepath;
+    std::getline(std::cin, filepath);
+
+    if(filepath.empty())
+      return;
+
+    bytecode_error error;
+    auto file = bytecode_file::open(filepath, error);
+    if(file == nullptr)
+    {
+      fmt::print("\nCould not load \"{}\": {}.\n", filepath, bytecode_error_to_str(error));
+      return;
+    }
+    virt_mach.set_program(file->load(true));
+    labels = file->symbols();
+    labels_owner = file;
+
+    fmt::print("\nLoaded {} bytes from \"{}\".\n", file->code().size(), filepath);
+  }
+
+  void REPL::write_bytecode()
+  {
+    fmt::print("File: ");
+
+    std::string filepath;
+    std::getline(std::cin, filepath);
+
+    if(filepath.empty())
+      return;
+
+    if(::write_bytecode(emit_bytecode(virt_mach.get_program(), labels), filepath))
+      fmt::print("\nProgram written to \"{}\".\n", filepath);
+    else
+      fmt::print("\nCould not write \"{}\".\n", filepath);
+  }
+}
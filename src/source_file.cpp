@@ -0,0 +1,189 @@
+#include <source_file.hpp>
+
+#include <utility>
+#include <istream>
+#include <cstring>
+
+#if defined(__unix__) || defined(__APPLE__)
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <fcntl.h>
+#include <unistd.h>
+#define H_LANG_HAS_MMAP 1
+#else
+#include <fstream>
+#include <iterator>
+#define H_LANG_HAS_MMAP 0
+#endif
+
+source_file::source_file()
+  : data(nullptr), size(0), mapped(false), contents()
+{  }
+
+source_file::~source_file()
+{
+#if H_LANG_HAS_MMAP
+  if(mapped)
+    munmap(const_cast<char*>(data), size);
+#endif
+}
+
+source_file::source_file(source_file&& other)
+  : data(std::exchange(other.data, nullptr)), size(std::exchange(other.size, 0)),
+    mapped(std::exchange(other.mapped, false)), contents(std::move(other.contents))
+{  }
+
+source_file& source_file::operator=(source_file&& other)
+{
+  // the old contents go away with `moved`
+  source_file moved(std::move(other));
+  std::swap(data, moved.data);
+  std::swap(size, moved.size);
+  std::swap(mapped, moved.mapped);
+  std::swap(contents, moved.contents);
+  return *this;
+}
+
+source_file source_file::from_text(std::string_view text)
+{
+  source_file src;
+  src.data = text.data();
+  src.size = text.size();
+  return src;
+}
+
+source_file source_file::copy_of(std::string_view text)
+{
+  source_file src;
+  src.contents.assign(text.begin(), text.end());
+  src.data = src.contents.data();
+  src.size = src.contents.size();
+  return src;
+}
+
+source_file source_file::open(const std::string& path)
+{
+  source_file src;
+
+#if H_LANG_HAS_MMAP
+  const int fd = ::open(path.c_str(), O_RDONLY);
+  if(fd < 0)
+    return src;
+
+  struct stat info;
+  if(fstat(fd, &info) == 0 && S_ISREG(info.st_mode) && info.st_size > 0)
+  {
+    void* mem = mmap(nullptr, info.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+    if(mem != MAP_FAILED)
+    {
+      // the lexer walks the file front to back
+      madvise(mem, info.st_size, MADV_SEQUENTIAL);
+
+      ::close(fd);
+      src.data = static_cast<const char*>(mem);
+      src.size = info.st_size;
+      src.mapped = true;
+      return src;
+    }
+  }
+
+  // pipes, character devices and whatever refused to be mapped
+  constexpr std::size_t block = 64 * 1024;
+  for(;;)
+  {
+    const std::size_t old_size = src.contents.size();
+    src.contents.resize(old_size + block);
+
+    const ssize_t got = ::read(fd, src.contents.data() + old_size, block);
+    src.contents.resize(old_size + (got > 0 ? got : 0));
+    if(got <= 0)
+      break;
+  }
+  ::close(fd);
+#else
+  std::ifstream in(path, std::ios::in | std::ios::binary);
+  src.contents.assign(std::istreambuf_iterator<char>(in), std::istreambuf_iterator<char>());
+#endif
+
+  src.data = src.contents.data();
+  src.size = src.contents.size();
+  return src;
+}
+
+std::string_view source_file::text() const
+{ return std::string_view(data, size); }
+
+
+source_stream::source_stream(std::istream& is)
+  : is(is), buffer(chunk_size), line_begin(0), filled(0), at_end(false), ring(kept_lines), rows(0)
+{  }
+
+bool source_stream::fill()
+{
+  if(at_end)
+    return false;
+
+  // move the unfinished line to the front, and only grow for lines longer than what is left
+  if(line_begin > 0)
+  {
+    std::memmove(buffer.data(), buffer.data() + line_begin, filled - line_begin);
+    filled -= line_begin;
+    line_begin = 0;
+  }
+  if(buffer.size() - filled < chunk_size / 2)
+    buffer.resize(buffer.size() + chunk_size);
+
+  is.read(buffer.data() + filled, buffer.size() - filled);
+  const std::size_t got = is.gcount();
+  filled += got;
+
+  if(got == 0)
+    at_end = true;
+  return got > 0;
+}
+
+bool source_stream::next_line(std::string_view& line)
+{
+  std::size_t searched = line_begin;
+  for(;;)
+  {
+    const char* const nl = static_cast<const char*>(std::memchr(buffer.data() + searched, '\n', filled - searched));
+    if(nl != nullptr)
+    {
+      const std::size_t end = nl - buffer.data();
+      line = std::string_view(buffer.data() + line_begin, end - line_begin);
+      line_begin = end + 1;
+      break;
+    }
+
+    // fill() moves the unfinished line to the front
+    const std::size_t scanned = filled - line_begin;
+    if(!fill())
+    {
+      // the last line might not end with a '\n'
+      if(line_begin == filled)
+        return false;
+      line = std::string_view(buffer.data() + line_begin, filled - line_begin);
+      line_begin = filled;
+      break;
+    }
+    searched = line_begin + scanned;
+  }
+
+  ring[rows % kept_lines].assign(line.data(), line.size());
+  ++rows;
+  return true;
+}
+
+std::optional<std::string_view> source_stream::kept_line(std::size_t row) const
+{
+  if(row < first_kept_row() || row > rows)
+    return std::nullopt;
+  return std::string_view(ring[(row - 1) % kept_lines]);
+}
+
+std::size_t source_stream::first_kept_row() const
+{ return rows > kept_lines ? rows - kept_lines + 1 : 1; }
+
+std::size_t source_stream::rows_read() const
+{ return rows; }
@@ -1,8 +1,11 @@
 #include <stream_lookup.hpp>
 
-#include <filesystem>
 #include <iostream>
-#include <cassert>
+
+#ifdef H_LANG_TESTING
+#include <filesystem>
+#include <fstream>
+#include <sstream>
 #include <iomanip>
 #include <chrono>
 
@@ -16,78 +19,95 @@ constexpr static auto cur_time = [](){
       ss << std::put_time(std::localtime(&in_time_t), "%Y-%m-%d %X");
       return ss.str();
     };
+#endif
 
 stream_lookup_t::stream_lookup_t()
-  : files(), map(),
-  stdin_module((fs::temp_directory_path() / ("STDIN_" + cur_time())).string())
+  : shards(), stdin_opened(), stdin_stream()
 #ifdef H_LANG_TESTING
   ,test_module((fs::temp_directory_path() / ("TEST_" + cur_time())).string())
 #endif
 {
 }
 
-stream_lookup_t::~stream_lookup_t()
-{
-  assert(map.empty() && "All streams must be dropped.");
-}
-
-void stream_lookup_t::process_stdin()
+std::string_view stream_lookup_t::resolve(std::string_view str)
 {
-#ifndef H_LANG_TESTING
-  std::ofstream output_writer(stdin_module);
-  output_writer << std::cin.rdbuf();
-  stdin_processed = true;
+#ifdef H_LANG_TESTING
+  if(str == "TESTSTREAM")
+  {
+    return test_module;
+  }
 #endif
+  return str;
 }
 
-std::istream& stream_lookup_t::operator[](std::string_view str)
+stream_lookup_t::shard& stream_lookup_t::shard_of(std::string_view str)
+{ return shards[std::hash<std::string_view>()(str) % shard_count]; }
+
+std::shared_ptr<const source_file> stream_lookup_t::operator[](std::string_view str)
 {
+  str = resolve(str);
+
   if(str == "STDIN")
   {
-    if(!stdin_processed)
-      process_stdin();
-    str = stdin_module;
+    // stdin is gone once it was read, all that is left are the kept lines
+    std::string kept;
+    if(source_stream* stream = line_stream(str))
+    {
+      for(std::size_t row = stream->first_kept_row(); row <= stream->rows_read(); ++row)
+      {
+        kept += *stream->kept_line(row);
+        kept += '\n';
+      }
+    }
+    return std::make_shared<const source_file>(source_file::copy_of(kept));
   }
-#ifdef H_LANG_TESTING
-  else if(str == "TESTSTREAM")
+
+  shard& s = shard_of(str);
   {
-    str = test_module;
+    std::lock_guard<std::mutex> guard(s.lock);
+    if(auto it = s.modules.find(std::string(str)); it != s.modules.end())
+      return it->second;
   }
-#endif
-  auto it = map.find(str);
-  assert(it == map.end() && "Stream should have been dropped.");
 
-  files.push_back(std::move(std::make_unique<std::ifstream>(str.data())));
+  // load without holding the lock, if two threads race for the same module the first one wins
+  auto loaded = std::make_shared<const source_file>(source_file::open(std::string(str)));
 
-  map[str] = files.end() - 1;
-
-  return *files.back();
+  std::lock_guard<std::mutex> guard(s.lock);
+  return s.modules.emplace(std::string(str), std::move(loaded)).first->second;
 }
 
 void stream_lookup_t::drop(std::string_view str)
 {
-  if(str == "STDIN")
-  {
-    str = stdin_module;
-  }
-#ifdef H_LANG_TESTING
-  else if(str == "TESTSTREAM")
-  {
-    str = test_module;
-  }
-#endif
-  auto it = map.find(str);
+  str = resolve(str);
 
-  assert(it != map.end() && "Stream should exist.");
+  shard& s = shard_of(str);
+  std::lock_guard<std::mutex> guard(s.lock);
+  s.modules.erase(std::string(str));
+}
+
+std::size_t stream_lookup_t::first_row(std::string_view str)
+{
+  if(source_stream* stream = line_stream(str))
+    return stream->first_kept_row();
+  return 1;
+}
 
-  files.erase(it->second);
-  map.erase(it);
+source_stream* stream_lookup_t::line_stream(std::string_view str)
+{
+  if(str != "STDIN")
+    return nullptr;
+
+  std::call_once(stdin_opened, [this]() { stdin_stream = std::make_unique<source_stream>(std::cin); });
+  return stdin_stream.get();
 }
 
 #ifdef H_LANG_TESTING
 void stream_lookup_t::write_test(std::string_view str)
 {
-  std::ofstream of(test_module);
-  of << str;
+  {
+    std::ofstream of(test_module);
+    of << str;
+  }
+  drop("TESTSTREAM");
 }
 #endif
@@ -1,76 +1,292 @@
 #include <symbol.hpp>
-#include <tmp.hpp>
 
+#include <cstring>
+#include <atomic>
+#include <memory>
 #include <mutex>
+#include <array>
 
-static std::mutex symbol_table_mutex;
+namespace
+{
+
+// 64 bit string hash after wyhash, strings are read 8 bytes at a time.
+// It only decides where a string lives in the interner, equality always compares the strings.
+std::uint64_t mix(std::uint64_t a, std::uint64_t b)
+{
+#if defined(__SIZEOF_INT128__)
+  __extension__ typedef unsigned __int128 u128;
+  const u128 r = static_cast<u128>(a) * b;
+  return static_cast<std::uint64_t>(r) ^ static_cast<std::uint64_t>(r >> 64);
+#else
+  const std::uint64_t r = (a ^ (a >> 32)) * b;
+  return r ^ (r >> 29);
+#endif
+}
+
+std::uint64_t hash_bytes(std::string_view str)
+{
+  constexpr std::uint64_t k0 = 0xA0761D6478BD642FULL;
+  constexpr std::uint64_t k1 = 0xE7037ED1A0B428DBULL;
+  constexpr std::uint64_t k2 = 0x8EBC6AF09C88C6E3ULL;
+
+  const char* p = str.data();
+  std::size_t len = str.size();
+
+  std::uint64_t h = mix(len ^ k0, k1);
+  for(; len >= 8; p += 8, len -= 8)
+  {
+    std::uint64_t word;
+    std::memcpy(&word, p, 8);
+    h = mix(h ^ word, k2);
+  }
+  std::uint64_t tail = 0;
+  std::memcpy(&tail, p, len);
+  h = mix(h ^ tail, k1 ^ len);
+
+  return mix(h, k0);
+}
+
+// Table from strings to dense ids and back.
+//
+// Strings are spread over shards by their hash. Each shard is an open addressing table whose
+//  slots are only ever filled, never cleared, so lookups run without locks. Adding a string
+//  takes the lock of its shard, that's what keeps one string from getting two ids.
+// A full table is replaced by a copy of twice the size, the old one stays alive for readers
+//  that still look at it. They might miss a string added after the copy and fall back to
+//  the locked path, which sees the current table.
+//
+// Ids index a list of segments that double in size, segments are never moved either.
+class interner
+{
+  struct entry
+  {
+    std::uint64_t hash;
+    std::uint32_t id;
+    std::string str;
+  };
+
+  struct table
+  {
+    explicit table(std::size_t capacity)
+      : slots(new std::atomic<const entry*>[capacity]), mask(capacity - 1), count(0)
+    {
+      for(std::size_t i = 0; i < capacity; ++i)
+        slots[i].store(nullptr, std::memory_order_relaxed);
+    }
+
+    std::unique_ptr<std::atomic<const entry*>[]> slots;
+    std::size_t mask;
+    std::size_t count; // guarded by the shard lock
+  };
+
+  struct shard
+  {
+    std::mutex lock;
+    std::atomic<table*> current { nullptr };
+
+    std::vector<std::unique_ptr<table>> tables;
+    std::vector<std::unique_ptr<entry>> entries;
+  };
+
+  static constexpr std::size_t shard_bits = 4;
+  static constexpr std::size_t initial_capacity = 256;
+
+  static constexpr std::size_t first_segment = 1024;
+  static constexpr std::size_t segment_count = 32;
+public:
+  interner()
+  {
+    for(auto& s : shards)
+    {
+      s.tables.emplace_back(new table(initial_capacity));
+      s.current.store(s.tables.back().get(), std::memory_order_release);
+    }
+    for(auto& seg : segments)
+      seg.store(nullptr, std::memory_order_relaxed);
+  }
+
+  std::uint32_t intern(std::string_view str)
+  {
+    const std::uint64_t hash = hash_bytes(str);
+    shard& s = shards[hash >> (64 - shard_bits)];
+
+    if(const entry* e = find(*s.current.load(std::memory_order_acquire), hash, str))
+      return e->id;
+
+    std::lock_guard<std::mutex> guard(s.lock);
+
+    table* t = s.current.load(std::memory_order_relaxed);
+    if(const entry* e = find(*t, hash, str))
+      return e->id;
+
+    if(2 * (t->count + 1) > t->mask + 1)
+      t = grow(s);
+
+    s.entries.emplace_back(new entry { hash, next_id.fetch_add(1, std::memory_order_relaxed), std::string(str) });
+    const entry* fresh = s.entries.back().get();
+
+    // the id has to resolve before anyone can find the string
+    publish(fresh);
+    insert(*t, fresh);
+    return fresh->id;
+  }
 
-tsl::robin_map<std::uint_fast64_t, std::string> symbol::symbols = {};
+  const std::string* find(std::uint32_t id) const
+  {
+    const auto [seg, offset] = locate(id);
+    const std::atomic<const entry*>* segment = segments[seg].load(std::memory_order_acquire);
+    if(segment == nullptr)
+      return nullptr;
+
+    const entry* e = segment[offset].load(std::memory_order_acquire);
+    return e != nullptr ? &e->str : nullptr;
+  }
+private:
+  static const entry* find(const table& t, std::uint64_t hash, std::string_view str)
+  {
+    for(std::size_t i = hash & t.mask; ; i = (i + 1) & t.mask)
+    {
+      const entry* e = t.slots[i].load(std::memory_order_acquire);
+      if(e == nullptr)
+        return nullptr;
+      if(e->hash == hash && e->str == str)
+        return e;
+    }
+  }
+
+  static void insert(table& t, const entry* e)
+  {
+    std::size_t i = e->hash & t.mask;
+    while(t.slots[i].load(std::memory_order_relaxed) != nullptr)
+      i = (i + 1) & t.mask;
+
+    t.slots[i].store(e, std::memory_order_release);
+    ++t.count;
+  }
+
+  static table* grow(shard& s)
+  {
+    const table& full = *s.current.load(std::memory_order_relaxed);
+
+    std::unique_ptr<table> bigger(new table(2 * (full.mask + 1)));
+    for(std::size_t i = 0; i <= full.mask; ++i)
+      if(const entry* e = full.slots[i].load(std::memory_order_relaxed))
+        insert(*bigger, e);
+
+    s.tables.push_back(std::move(bigger));
+    s.current.store(s.tables.back().get(), std::memory_order_release);
+    return s.tables.back().get();
+  }
+
+  // segment k holds first_segment << k ids
+  static std::pair<std::size_t, std::size_t> locate(std::uint32_t id)
+  {
+    const std::uint64_t n = id / first_segment + 1;
+
+    std::size_t seg = 0;
+    while((n >> (seg + 1)) != 0)
+      ++seg;
+    return { seg, id - first_segment * ((std::uint64_t { 1 } << seg) - 1) };
+  }
+
+  void publish(const entry* e)
+  {
+    const auto [seg, offset] = locate(e->id);
+
+    std::atomic<const entry*>* segment = segments[seg].load(std::memory_order_acquire);
+    if(segment == nullptr)
+    {
+      // shards add ids concurrently, so the segment may get allocated twice
+      const std::size_t size = first_segment << seg;
+      std::unique_ptr<std::atomic<const entry*>[]> fresh(new std::atomic<const entry*>[size]);
+      for(std::size_t i = 0; i < size; ++i)
+        fresh[i].store(nullptr, std::memory_order_relaxed);
+
+      if(segments[seg].compare_exchange_strong(segment, fresh.get(), std::memory_order_acq_rel,
+                                                                     std::memory_order_acquire))
+        segment = fresh.release();
+    }
+    segment[offset].store(e, std::memory_order_release);
+  }
+private:
+  std::array<shard, std::size_t { 1 } << shard_bits> shards;
+  std::atomic<std::uint32_t> next_id { 0 };
+
+  std::array<std::atomic<std::atomic<const entry*>*>, segment_count> segments;
+};
+
+// Never destroyed, symbols may still be used while other statics are torn down.
+interner& symbols()
+{
+  static interner* table = new interner();
+  return *table;
+}
+
+}
 
 symbol::symbol(const std::string& str)
-  : hash(hash_string(str))
-{ lookup_or_emplace(hash, str.c_str()); }
+  : id(lookup_or_emplace(str))
+{  }
 
 symbol::symbol(const char* str)
-  : hash(hash_string(str))
-{ lookup_or_emplace(hash, str); }
+  : id(lookup_or_emplace(str))
+{  }
 
-symbol::symbol(const symbol& s)
-  : hash(s.hash)
+symbol::symbol(std::string_view str)
+  : id(lookup_or_emplace(str))
 {  }
 
-symbol::symbol(symbol&& s)
-  : hash(s.hash)
+symbol::symbol(const symbol& s)
+  : id(s.id)
 {  }
 
-symbol::~symbol() noexcept
+symbol::symbol(symbol&& s)
+  : id(s.id)
 {  }
 
 symbol& symbol::operator=(const std::string& str)
 {
-  this->hash = hash_string(str);
-  lookup_or_emplace(this->hash, str.c_str());
+  this->id = lookup_or_emplace(str);
 
   return *this;
 }
 
 symbol& symbol::operator=(const char* str)
 {
-  this->hash = hash_string(str);
-  lookup_or_emplace(this->hash, str);
+  this->id = lookup_or_emplace(str);
 
   return *this;
 }
 
 symbol& symbol::operator=(const symbol& s)
 {
-  this->hash = s.hash;
+  this->id = s.id;
 
   return *this;
 }
 
 symbol& symbol::operator=(symbol&& s)
 {
-  this->hash = s.hash;
+  this->id = s.id;
 
   return *this;
 }
 
 std::ostream& operator<<(std::ostream& os, const symbol& symb)
 {
-  os << symbol::symbols[symb.hash];
+  os << symbol::lookup(symb.id);
   return os;
 }
 
-std::string& symbol::lookup_or_emplace(std::uint_fast64_t hash, const char* str)
+std::uint32_t symbol::lookup_or_emplace(std::string_view str)
+{ return symbols().intern(str); }
+
+const std::string& symbol::lookup(std::uint32_t id)
 {
-  auto it = symbols.find(hash);
-  if(it != symbols.end())
-    return symbols[hash];
+  static const std::string unknown;
 
-  std::lock_guard<std::mutex> lock(symbol_table_mutex);
-  symbols[hash] = str;
-  return symbols[hash];
+  const std::string* str = symbols().find(id);
+  return str != nullptr ? *str : unknown;
 }
 
 std::ostream& operator<<(std::ostream& os, const std::vector<symbol>& symbs)
@@ -80,20 +296,20 @@ std::ostream& operator<<(std::ostream& os, const std::vector<symbol>& symbs)
   return os;
 }
 
-std::uint_fast64_t symbol::get_hash() const
-{ return hash; }
+std::uint32_t symbol::get_id() const
+{ return id; }
 
 const std::string& symbol::get_string() const
-{ return symbols[hash]; }
+{ return lookup(id); }
 
 bool operator==(const symbol& a, const symbol& b)
 {
-  return a.get_hash() == b.get_hash();
+  return a.get_id() == b.get_id();
 }
 
 bool operator!=(const symbol& a, const symbol& b)
 {
-  return a.get_hash() != b.get_hash();
+  return a.get_id() != b.get_id();
 }
 
 
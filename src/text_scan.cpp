@@ -0,0 +1,162 @@
+#include <text_scan.hpp>
+
+#if defined(__x86_64__) && (defined(__GNUC__) || defined(__clang__))
+#include <immintrin.h>
+#define H_LANG_HAS_X86_SIMD 1
+#else
+#define H_LANG_HAS_X86_SIMD 0
+#endif
+
+namespace
+{
+
+const char* skip_line_spaces_scalar(const char* first, const char* last)
+{
+  while(first != last && is_line_space(*first))
+    ++first;
+  return first;
+}
+
+const char* find_word_break_scalar(const char* first, const char* last)
+{
+  while(first != last && !is_word_break(*first))
+    ++first;
+  return first;
+}
+
+#if H_LANG_HAS_X86_SIMD
+
+// Both vector versions classify a whole block at once and take the first hit from the bit mask
+//  of the comparison. Ranges are tested as unsigned `x - lo <= hi - lo`, SSE2 and AVX2 only
+//  compare signed bytes, so that is spelled `min(x - lo, hi - lo) == x - lo`.
+
+__m128i in_range_sse2(__m128i x, char lo, char hi)
+{
+  const __m128i d = _mm_sub_epi8(x, _mm_set1_epi8(lo));
+  return _mm_cmpeq_epi8(_mm_min_epu8(d, _mm_set1_epi8(hi - lo)), d);
+}
+
+__m128i line_spaces_sse2(__m128i x)
+{ return _mm_or_si128(in_range_sse2(x, '\t', '\r'), _mm_cmpeq_epi8(x, _mm_set1_epi8(' '))); }
+
+__m128i word_breaks_sse2(__m128i x)
+{
+  __m128i m = in_range_sse2(x, 0, ' ');
+  m = _mm_or_si128(m, _mm_cmpeq_epi8(x, _mm_set1_epi8(127)));
+  m = _mm_or_si128(m, in_range_sse2(x, '(', '.'));
+  m = _mm_or_si128(m, in_range_sse2(x, ':', ';'));
+  m = _mm_or_si128(m, _mm_cmpeq_epi8(x, _mm_set1_epi8('=')));
+  m = _mm_or_si128(m, in_range_sse2(x, '[', ']'));
+  return _mm_or_si128(m, in_range_sse2(x, '{', '}'));
+}
+
+const char* skip_line_spaces_sse2(const char* first, const char* last)
+{
+  for(; last - first >= 16; first += 16)
+  {
+    const __m128i x = _mm_loadu_si128(reinterpret_cast<const __m128i*>(first));
+    const unsigned mask = ~static_cast<unsigned>(_mm_movemask_epi8(line_spaces_sse2(x))) & 0xFFFF;
+    if(mask != 0)
+      return first + __builtin_ctz(mask);
+  }
+  return skip_line_spaces_scalar(first, last);
+}
+
+const char* find_word_break_sse2(const char* first, const char* last)
+{
+  for(; last - first >= 16; first += 16)
+  {
+    const __m128i x = _mm_loadu_si128(reinterpret_cast<const __m128i*>(first));
+    const unsigned mask = _mm_movemask_epi8(word_breaks_sse2(x));
+    if(mask != 0)
+      return first + __builtin_ctz(mask);
+  }
+  return find_word_break_scalar(first, last);
+}
+
+#define H_LANG_AVX2 __attribute__((target("avx2")))
+
+H_LANG_AVX2 __m256i in_range_avx2(__m256i x, char lo, char hi)
+{
+  const __m256i d = _mm256_sub_epi8(x, _mm256_set1_epi8(lo));
+  return _mm256_cmpeq_epi8(_mm256_min_epu8(d, _mm256_set1_epi8(hi - lo)), d);
+}
+
+H_LANG_AVX2 __m256i line_spaces_avx2(__m256i x)
+{ return _mm256_or_si256(in_range_avx2(x, '\t', '\r'), _mm256_cmpeq_epi8(x, _mm256_set1_epi8(' '))); }
+
+H_LANG_AVX2 __m256i word_breaks_avx2(__m256i x)
+{
+  __m256i m = in_range_avx2(x, 0, ' ');
+  m = _mm256_or_si256(m, _mm256_cmpeq_epi8(x, _mm256_set1_epi8(127)));
+  m = _mm256_or_si256(m, in_range_avx2(x, '(', '.'));
+  m = _mm256_or_si256(m, in_range_avx2(x, ':', ';'));
+  m = _mm256_or_si256(m, _mm256_cmpeq_epi8(x, _mm256_set1_epi8('=')));
+  m = _mm256_or_si256(m, in_range_avx2(x, '[', ']'));
+  return _mm256_or_si256(m, in_range_avx2(x, '{', '}'));
+}
+
+H_LANG_AVX2 const char* skip_line_spaces_avx2(const char* first, const char* last)
+{
+  for(; last - first >= 32; first += 32)
+  {
+    const __m256i x = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(first));
+    const unsigned mask = ~static_cast<unsigned>(_mm256_movemask_epi8(line_spaces_avx2(x)));
+    if(mask != 0)
+      return first + __builtin_ctz(mask);
+  }
+  return skip_line_spaces_sse2(first, last);
+}
+
+H_LANG_AVX2 const char* find_word_break_avx2(const char* first, const char* last)
+{
+  for(; last - first >= 32; first += 32)
+  {
+    const __m256i x = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(first));
+    const unsigned mask = _mm256_movemask_epi8(word_breaks_avx2(x));
+    if(mask != 0)
+      return first + __builtin_ctz(mask);
+  }
+  return find_word_break_sse2(first, last);
+}
+
+#undef H_LANG_AVX2
+
+#endif
+
+struct text_scanner
+{
+  const char* (*skip_line_spaces)(const char*, const char*);
+  const char* (*find_word_break)(const char*, const char*);
+  std::string_view name;
+};
+
+text_scanner select_scanner()
+{
+#if H_LANG_HAS_X86_SIMD
+  // SSE2 is part of x86-64, AVX2 has to be asked for
+  if(__builtin_cpu_supports("avx2"))
+    return { skip_line_spaces_avx2, find_word_break_avx2, "avx2" };
+  return { skip_line_spaces_sse2, find_word_break_sse2, "sse2" };
+#else
+  return { skip_line_spaces_scalar, find_word_break_scalar, "scalar" };
+#endif
+}
+
+const text_scanner& scanner()
+{
+  static const text_scanner selected = select_scanner();
+  return selected;
+}
+
+}
+
+const char* skip_line_spaces(const char* first, const char* last)
+{ return scanner().skip_line_spaces(first, last); }
+
+const char* find_word_break(const char* first, const char* last)
+{ return scanner().find_word_break(first, last); }
+
+std::string_view text_scan_implementation()
+{ return scanner().name; }
+
@@ -0,0 +1,165 @@
+#include <thread_pool.hpp>
+
+#include <algorithm>
+#include <atomic>
+
+namespace
+{
+
+// index of the worker running on this thread, none for threads outside of any pool
+constexpr std::size_t no_worker = static_cast<std::size_t>(-1);
+thread_local thread_pool* current_pool = nullptr;
+thread_local std::size_t current_worker = no_worker;
+
+}
+
+thread_pool::thread_pool(std::size_t threads)
+{
+  const std::size_t count = threads != 0 ? threads : std::max(1U, std::thread::hardware_concurrency());
+
+  queues.reserve(count);
+  for(std::size_t i = 0; i < count; ++i)
+    queues.emplace_back(std::make_unique<job_queue>());
+
+  workers.reserve(count);
+  for(std::size_t i = 0; i < count; ++i)
+    workers.emplace_back(&thread_pool::work, this, i);
+}
+
+thread_pool::~thread_pool()
+{
+  {
+    std::lock_guard<std::mutex> guard(state_lock);
+    stopping = true;
+  }
+  wake.notify_all();
+
+  for(auto& w : workers)
+    w.join();
+}
+
+std::size_t thread_pool::thread_count() const
+{ return workers.size(); }
+
+void thread_pool::submit(std::function<void()> job)
+{
+  {
+    std::lock_guard<std::mutex> guard(state_lock);
+
+    const std::size_t id = current_pool == this ? current_worker : next_queue++ % queues.size();
+
+    // queued is only decremented after a pop, which can't happen before the push below
+    std::lock_guard<std::mutex> queue_guard(queues[id]->lock);
+    queues[id]->jobs.push_back(std::move(job));
+    ++queued;
+    ++pending;
+  }
+  wake.notify_one();
+}
+
+void thread_pool::wait()
+{
+  std::unique_lock<std::mutex> guard(state_lock);
+  idle.wait(guard, [this]() { return pending == 0; });
+}
+
+void thread_pool::for_each(std::size_t count, std::function<void(std::size_t)> job)
+{
+  // Helpers may start after we returned, they only touch the shared state then
+  struct shared_state
+  {
+    std::function<void(std::size_t)> job;
+    std::size_t count;
+    std::atomic<std::size_t> next { 0 };
+
+    std::mutex lock;
+    std::condition_variable finished;
+    std::size_t done { 0 }; // guarded by lock
+  };
+  auto state = std::make_shared<shared_state>();
+  state->job = std::move(job);
+  state->count = count;
+
+  auto run = [state]()
+  {
+    std::size_t ran = 0;
+    for(std::size_t i; (i = state->next.fetch_add(1)) < state->count; ++ran)
+      state->job(i);
+    if(ran == 0)
+      return;
+
+    std::lock_guard<std::mutex> guard(state->lock);
+    state->done += ran;
+    if(state->done == state->count)
+      state->finished.notify_all();
+  };
+
+  // we run jobs ourselves, so one helper less than jobs is enough
+  const std::size_t helpers = count == 0 ? 0 : std::min(count - 1, workers.size());
+  for(std::size_t i = 0; i < helpers; ++i)
+    submit(run);
+  run();
+
+  // whatever is left is running on other threads right now, so this can't deadlock
+  std::unique_lock<std::mutex> guard(state->lock);
+  state->finished.wait(guard, [&state]() { return state->done == state->count; });
+}
+
+thread_pool* thread_pool::current()
+{ return current_pool; }
+
+bool thread_pool::pop(std::size_t id, std::function<void()>& job)
+{
+  for(std::size_t i = 0; i < queues.size(); ++i)
+  {
+    job_queue& q = *queues[(id + i) % queues.size()];
+
+    std::lock_guard<std::mutex> guard(q.lock);
+    if(q.jobs.empty())
+      continue;
+
+    // our own newest job is likely still warm in the cache, a thief takes the oldest one
+    if(i == 0)
+    {
+      job = std::move(q.jobs.back());
+      q.jobs.pop_back();
+    }
+    else
+    {
+      job = std::move(q.jobs.front());
+      q.jobs.pop_front();
+    }
+    return true;
+  }
+  return false;
+}
+
+void thread_pool::work(std::size_t id)
+{
+  current_pool = this;
+  current_worker = id;
+
+  for(;;)
+  {
+    std::function<void()> job;
+    if(pop(id, job))
+    {
+      {
+        std::lock_guard<std::mutex> guard(state_lock);
+        --queued;
+      }
+      job();
+
+      std::lock_guard<std::mutex> guard(state_lock);
+      if(--pending == 0)
+        idle.notify_all();
+      continue;
+    }
+
+    std::unique_lock<std::mutex> guard(state_lock);
+    wake.wait(guard, [this]() { return queued > 0 || stopping; });
+    if(stopping && queued == 0)
+      return;
+  }
+}
+
@@ -1,6 +1,7 @@
 #include <assembler.hpp>
 #include <token.hpp>
 #include <cassert>
+#include <algorithm>
 
 std::string_view kind_to_str(token_kind kind)
 {
@@ -34,7 +35,18 @@ std::string_view kind_to_str(token_kind kind)
   }
 }
 
-std::vector<unsigned char> generic_token<ass::token_kind>::to_u8_vec(const ass::program& assm) const
+std::size_t generic_token<ass::token_kind>::encoded_size() const
+{
+  switch(kind)
+  {
+  default:                              return 0;
+  case ass::token_kind::Register:       return 1;
+  case ass::token_kind::ImmediateValue:
+  case ass::token_kind::LabelUse:       return 2;
+  }
+}
+
+unsigned char* generic_token<ass::token_kind>::encode(unsigned char* out, const ass::program& assm) const
 {
   try
   {
@@ -42,28 +54,28 @@ std::vector<unsigned char> generic_token<ass::token_kind>::to_u8_vec(const ass::
     {
     default:
       assert(false && "Parser should have handled this.");
+      return out;
 
     case ass::token_kind::Register:
-      return { static_cast<unsigned char>(std::stoi(data.get_string())) };
+      *out++ = static_cast<unsigned char>(std::stoi(data.get_string()));
+      return out;
 
     case ass::token_kind::ImmediateValue:
       {
         std::int_fast16_t tmp = std::stoi(data.get_string());
 
-        unsigned char first = (tmp & 0b11111111'00000000) >> 8;
-        unsigned char second = tmp & 0b11111111;
-
-        return { first, second };
+        *out++ = (tmp & 0b11111111'00000000) >> 8;
+        *out++ = tmp & 0b11111111;
+        return out;
       }
 
     case ass::token_kind::LabelUse:
       {
         const auto& p = assm.lookup_symbol(data);
 
-        unsigned char first  = (p.second & 0b11111111'00000000) >> 8;
-        unsigned char second = p.second & 0b11111111;
-
-        return { first, second };
+        *out++ = (p.second & 0b11111111'00000000) >> 8;
+        *out++ = p.second & 0b11111111;
+        return out;
       }
     }
   }
@@ -71,30 +83,38 @@ std::vector<unsigned char> generic_token<ass::token_kind>::to_u8_vec(const ass::
   {
     assert(false && "Parser should have handled this.");
 
-    return {};
+    // keep the layout that encoded_size promised
+    return std::fill_n(out, encoded_size(), 0);
   }
 }
 
 namespace ass
 {
 
-std::vector<unsigned char> instruction::to_u8_vec(const program& assm) const
+std::size_t instruction::encoded_size() const
+{
+  // TODO: Add directives
+  if(!op)
+    return 0;
+
+  std::size_t size = 1;
+  for(auto& t : args)
+    size += t.encoded_size();
+  return size;
+}
+
+unsigned char* instruction::encode(unsigned char* out, const program& assm) const
 {
   // TODO: Add directives
   if(op)
   {
     // We have an instruction
-    std::vector<unsigned char> to_return { static_cast<unsigned char>(*op) };
+    *out++ = static_cast<unsigned char>(*op);
 
     for(auto& t : args)
-    {
-      const auto& arg = t.to_u8_vec(assm);
-
-      std::move(arg.begin(), arg.end(), std::back_inserter(to_return));
-    }
-    return to_return;
+      out = t.encode(out, assm);
   }
-  return {};
+  return out;
 }
 
 }
@@ -3,10 +3,15 @@
 #include <diagnostic_db.hpp>
 #include <stream_lookup.hpp>
 #include <fixit_info.hpp>
+#include <text_scan.hpp>
 
 
 #include <vm.hpp>
 
+#include <charconv>
+#include <cstring>
+#include <array>
+
 using namespace std::literals::string_view_literals;
 
 namespace ass
@@ -31,11 +36,16 @@ auto keyword_map = tsl::robin_map<std::string_view, op_code>({
   { "inc"sv,     op_code::INC },
   { "dec"sv,     op_code::DEC },
   { "shl"sv,     op_code::SHIFT_LEFT },
-  { "shr"sv,     op_code::SHIFT_RIGHT }
+  { "shr"sv,     op_code::SHIFT_RIGHT },
+  { "loadm"sv,   op_code::LOADM },
+  { "storem"sv,  op_code::STOREM }
 });
 }
 
-auto keyword_set = tsl::robin_set<std::string_view>({
+namespace
+{
+
+constexpr std::array<std::string_view, 8> keywords = {
   "TOP"sv,
   "BOT"sv,
   "Type"sv,
@@ -44,53 +54,96 @@ auto keyword_set = tsl::robin_set<std::string_view>({
   "type"sv,
   "data"sv,
   "case"sv
-});
+};
 
-auto operator_symbols_map = tsl::robin_map<std::string_view, token_kind>({
-  {"\\"sv, token_kind::Backslash},
-  {"|"sv, token_kind::Pipe},
-  {":"sv, token_kind::Colon},
-  {";"sv, token_kind::Semi},
-  {"{"sv, token_kind::LBrace},
-  {"}"sv, token_kind::RBrace},
-  {"+"sv, token_kind::Plus},
-  {"-"sv, token_kind::Minus},
-  {"*"sv,  token_kind::Asterisk},
-  {"="sv,  token_kind::Equal},
-  {"."sv,  token_kind::Dot},
-  {"("sv,  token_kind::LParen},
-  {")"sv,  token_kind::RParen},
-  {"["sv,  token_kind::LBracket},
-  {"]"sv,  token_kind::RBracket},
-  {","sv,  token_kind::Comma},
-});
+constexpr std::size_t max_keyword_length = 4;
+
+constexpr bool is_keyword(std::string_view name)
+{
+  if(name.size() > max_keyword_length)
+    return false;
+  for(auto kw : keywords)
+    if(kw == name)
+      return true;
+  return false;
+}
+
+constexpr std::string_view operator_chars = "\\|:;{}+-*=.()[],"sv;
+
+// token kind of every character that is an operator on its own, Undef for all others
+constexpr std::array<token_kind, 256> make_operator_table()
+{
+  std::array<token_kind, 256> table {};
+  for(char c : operator_chars)
+    table[static_cast<unsigned char>(c)] = static_cast<token_kind>(c);
+  return table;
+}
+constexpr auto operator_table = make_operator_table();
+
+constexpr bool breaks_on_every_operator()
+{
+  for(char c : operator_chars)
+    if(!is_word_break(c))
+      return false;
+  return true;
+}
+static_assert(breaks_on_every_operator(), "Every operator character must end an identifier, see text_scan.hpp.");
+
+// control characters and whitespace, the only things that end a word of assembly
+constexpr bool is_blank(char c)
+{
+  const unsigned char u = static_cast<unsigned char>(c);
+  return u <= ' ' || u == 127;
+}
+
+constexpr bool is_digit(char c)
+{ return '0' <= c && c <= '9'; }
+
+}
 
 constexpr static bool isprint(unsigned char c)
 { return (' ' <= c && c <= '~'); }
 
 base_reader::base_reader(std::string_view module)
-  : module(module), is(stream_lookup[module]), linebuf(), col(0), row(1), uses_reader(true)
-{  }
+  : module(module), src(), stream(stream_lookup.line_stream(module)), linebuf(), col(0), row(1)
+{
+  if(stream == nullptr)
+    src = stream_lookup[module];
+}
 
-base_reader::base_reader(std::istream& stream)
-  : module("#TXT#"), is(stream), linebuf(), col(0), row(1)
+base_reader::base_reader(source_file text)
+  : module("#TXT#"), src(std::make_shared<const source_file>(std::move(text))), linebuf(), col(0), row(1)
 {  }
 
-base_reader::~base_reader()
-{ if(uses_reader) stream_lookup.drop(module); }
+bool base_reader::next_line()
+{
+  if(stream != nullptr)
+    return stream->next_line(linebuf);
+
+  const std::string_view text = src->text();
+  if(next_line_pos >= text.size())
+    return false;
+
+  // memchr is vectorized by the C library, so finding line ends runs at memory speed
+  const char* const begin = text.data() + next_line_pos;
+  const char* const nl = static_cast<const char*>(std::memchr(begin, '\n', text.size() - next_line_pos));
+  const char* const end = nl != nullptr ? nl : text.data() + text.size();
+
+  linebuf = std::string_view(begin, end - begin);
+  next_line_pos = (end - text.data()) + (nl != nullptr ? 1 : 0);
+  return true;
+}
 
 char base_reader::getc()
 {
   // yields the next char that is not a basic whitespace character i.e. NOT stuff like zero width space
-  char ch = 0;
-  bool skipped_line = false;
-  do
+  for(;;)
   {
     if(col >= linebuf.size())
     {
       if(!linebuf.empty())
         row++;
-      if(!(std::getline(is, linebuf)))
+      if(!next_line())
       {
         col = 1;
         linebuf = "";
@@ -101,7 +154,7 @@ char base_reader::getc()
         while(linebuf.empty())
         {
           row++;
-          if(!(std::getline(is, linebuf)))
+          if(!next_line())
           {
             col = 1;
             linebuf = "";
@@ -111,23 +164,13 @@ char base_reader::getc()
       }
       col = 0;
     }
-    ch = linebuf[col++];
-    if(std::isspace(ch))
-    {
-      skipped_line = true;
-      while(col < linebuf.size())
-      {
-        ch = linebuf[col++];
-        if(!(std::isspace(ch)))
-        {
-          skipped_line = false;
-          break;
-        }
-      }
-    }
-  } while(skipped_line);
+    const char* const line = linebuf.data();
+    col = skip_line_spaces(line + col, line + linebuf.size()) - line;
+    if(col < linebuf.size())
+      return linebuf[col++];
 
-  return ch;
+    // nothing but whitespace left on this line
+  }
 }
 
 
@@ -135,8 +178,10 @@ char base_reader::getc()
 
 token hx_reader::gett()
 {
+  static const symbol none(""), equal("="), doublearrow("=>"), minus("-"), arrow("->"), eof("EOF");
+
 restart_get:
-  symbol data("");
+  symbol data = none;
   token_kind kind = token_kind::Undef;
 
   char ch = getc();
@@ -147,30 +192,29 @@ restart_get:
   switch(ch)
   {
   default:
-    if(!std::iscntrl(ch) && !std::isspace(ch))
+    if(const token_kind op = operator_table[static_cast<unsigned char>(ch)]; op != token_kind::Undef)
+    {
+      kind = op;
+      data = symbol(std::string_view(linebuf.data() + beg_col, 1));
+    }
+    else if(!is_word_break(ch))
     {
       // Optimistically allow any kind of identifier to allow for unicode
-      std::string name;
-      name.push_back(ch);
-      while(col < linebuf.size())
+      // don't use getc() here, identifiers are not connected with a '\n'
+      // a keyword ends the identifier right away, so "Typex" is "Type" followed by "x"
+      std::size_t end = find_word_break(linebuf.data() + col, linebuf.data() + linebuf.size()) - linebuf.data();
+      for(std::size_t len = 1; len <= max_keyword_length && beg_col + len < end; ++len)
       {
-        // don't use get<char>() here, identifiers are not connected with a '\n'
-        ch = linebuf[col++];
-
-        // we look up in the operator map only for the single char. otherwise we wont parse y:= not correctly for example
-        std::string ch_s;
-        ch_s.push_back(ch);
-        // break if we hit whitespace (or other control chars) or any other operator symbol char
-        if(std::iscntrl(ch) || std::isspace(ch) || operator_symbols_map.contains(ch_s.c_str()) || keyword_set.contains(name.c_str()))
+        if(is_keyword(linebuf.substr(beg_col, len)))
         {
-          col--;
+          end = beg_col + len;
           break;
         }
-        name.push_back(ch);
       }
-      kind = (operator_symbols_map.contains(name.c_str()) ? operator_symbols_map[name.c_str()] : token_kind::Identifier);
-      kind = (keyword_set.contains(name.c_str()) ? token_kind::Keyword : kind);
+      col = end;
 
+      const std::string_view name = linebuf.substr(beg_col, col - beg_col);
+      kind = is_keyword(name) ? token_kind::Keyword : token_kind::Identifier;
       data = symbol(name);
     }
     else
@@ -183,30 +227,18 @@ restart_get:
   case '5': case '6': case '7': case '8': case '9':
     {
       // readin until there is no number anymore. Disallow 000840
-      std::string name;
-      name.push_back(ch);
+      // This could give problems with floaing point numbers since 2.3 will now be parsed as "2" "." "3" so to literals and a point
+      col = find_word_break(linebuf.data() + col, linebuf.data() + linebuf.size()) - linebuf.data();
+      const std::string_view name = linebuf.substr(beg_col, col - beg_col);
+
       bool emit_not_a_number_error = false;
       bool emit_starts_with_zero_error = false;
-      while(col < linebuf.size())
+      for(char digit : name.substr(1))
       {
-        // don't use get<char>() here, numbers are not connected with a '\n'
-        ch = linebuf[col++];
-
-        // we look up in the operator map only for the single char. otherwise we wont parse 2; not correctly for example
-        // This could give problems with floaing point numbers since 2.3 will now be parsed as "2" "." "3" so to literals and a point
-        std::string ch_s;
-        ch_s.push_back(ch);
-        // break if we hit whitespace (or other control chars) or any other token char
-        if(std::iscntrl(ch) || std::isspace(ch) || operator_symbols_map.count(ch_s.c_str()) || keyword_set.count(name.c_str()))
-        {
-          col--;
-          break;
-        }
-        if(!std::isdigit(ch))
+        if(!is_digit(digit))
           emit_not_a_number_error = true;
         if(starts_with_zero && !emit_not_a_number_error)
           emit_starts_with_zero_error = true;
-        name.push_back(ch);
       }
       if(emit_starts_with_zero_error)
       {
@@ -226,109 +258,32 @@ restart_get:
     if(col < linebuf.size() && linebuf[col] == '>')
     {
       kind = token_kind::Doublearrow;
-      data = "=>";
+      data = doublearrow;
       ch = linebuf[col++];
     }
     else
     {
       kind = token_kind::Equal;
-      data = "=";
+      data = equal;
     }
   } break;
-  /*
-  case '_':
-  {
-    kind = token_kind::Underscore;
-    data = "_";
-  } break;
-  */
-  case '|':
-  {
-    kind = token_kind::Pipe;
-    data = "|";
-  } break;
-  case '*':
-  {
-    kind = token_kind::Asterisk;
-    data = "*";
-  } break;
-  case '+':
-  {
-    kind = token_kind::Plus;
-    data = "+";
-  } break;
   case '-':
   {
     if(col < linebuf.size() && linebuf[col] == '>')
     {
       kind = token_kind::Arrow;
-      data = "->";
+      data = arrow;
       ch = linebuf[col++];
     }
     else
     {
       kind = token_kind::Minus;
-      data = "-";
+      data = minus;
     }
   } break;
-  case '{':
-    {
-      kind = token_kind::LBrace;
-      data = "{";
-    } break;
-  case '}':
-    {
-      kind = token_kind::RBrace;
-      data = "}";
-    } break;
-  case '[':
-    {
-      kind = token_kind::LBracket;
-      data = "[";
-    } break;
-  case ']':
-    {
-      kind = token_kind::RBracket;
-      data = "]";
-    } break;
-  case ';':
-  {
-    kind = token_kind::Semi;
-    data = ";";
-  } break;
-  case ':':
-  {
-    kind = token_kind::Colon;
-    data = ":";
-  } break;
-  case '\\':
-  {
-    kind = token_kind::Backslash;
-    data = "\\";
-  } break;
-  case '.':
-  {
-    kind = token_kind::Dot;
-    data = ".";
-  } break;
-  case '(':
-  {
-    kind = token_kind::LParen;
-    data = "(";
-  } break;
-  case ')':
-  {
-    kind = token_kind::RParen;
-    data = ")";
-  } break;
-  case ',':
-  {
-    kind = token_kind::Comma;
-    data = ",";
-  } break;
   case EOF:
       kind = token_kind::EndOfFile;
-      data = "EOF";
+      data = eof;
     break;
   }
   return token(kind, data, {module, beg_col + 1, beg_row, col + 1, row + 1});
@@ -336,8 +291,10 @@ restart_get:
 
 ass::token asm_reader::gett()
 {
+  static const symbol none(""), eof("EOF");
+
 restart_get:
-  symbol data("");
+  symbol data = none;
   ass::token_kind kind = ass::token_kind::Undef;
   op_code opc = op_code::UNKNOWN;
 
@@ -349,64 +306,48 @@ restart_get:
   switch(ch)
   {
   default:
-    if(!std::iscntrl(ch) && !std::isspace(ch))
+    if(!is_blank(ch))
     {
       // Optimistically allow any kind of identifier to allow for unicode
-      std::string name;
-      name.push_back(ch);
-      while(col < linebuf.size())
-      {
-        // don't use get<char>() here, identifiers are not connected with a '\n'
-        ch = linebuf[col++];
+      // don't use getc() here, identifiers are not connected with a '\n'
+      while(col < linebuf.size() && !is_blank(linebuf[col]))
+        ++col;
 
-        // we look up in the operator map only for the single char. otherwise we wont parse y:= not correctly for example
-        std::string ch_s;
-        ch_s.push_back(ch);
-        // break if we hit whitespace (or other control chars) or any other operator symbol char
-        if(std::iscntrl(ch) || std::isspace(ch))
-        {
-          col--;
-          break;
-        }
-        name.push_back(ch);
-      }
+      const std::string_view name(linebuf.data() + beg_col, col - beg_col);
       data = symbol(name);
       if(auto it = ass::keyword_map.find(name); it != ass::keyword_map.end())
       { kind = ass::token_kind::Opcode; opc = it->second; }
       else
       {
         // could also be a register
-        if(!name.empty() && name[0] == '$')
+        if(name[0] == '$')
         {
-          try
+          std::size_t regnum = 0;
+          const auto [end, err] = std::from_chars(name.data() + 1, name.data() + name.size(), regnum);
+          if(err == std::errc())
           {
-            std::size_t regnum = std::stoi(std::string(std::next(name.begin()), name.end()));
-
-            if(regnum > vm::register_count - 1) // we only have so many registers
-              kind = ass::token_kind::Undef;
-
-            data = symbol(std::string(std::next(name.begin()), name.end()));
+            data = symbol(name.substr(1));
             kind = ass::token_kind::Register;
           }
-          catch(...)
-          { kind = ass::token_kind::Undef; }
+          else
+            kind = ass::token_kind::Undef;
         }
         // could also be a labeldef
         else if(name.size() > 1 && name.back() == ':')
         {
-          data = symbol(std::string(std::next(name.begin()), name.end()));
+          data = symbol(name.substr(0, name.size() - 1));
           kind = ass::token_kind::LabelDef;
         }
         // or labeluse
-        else if(!name.empty() && name.front() == '%')
+        else if(name.front() == '%')
         {
-          data = symbol(std::string(std::next(name.begin()), name.end()));
+          data = symbol(name.substr(1));
           kind = ass::token_kind::LabelUse;
         }
         // or directive    i.e. .text/.code, .data
-        else if(!name.empty() && name.front() == '.')
+        else if(name.front() == '.')
         {
-          data = symbol(std::string(std::next(name.begin()), name.end()));
+          data = symbol(name.substr(1));
           kind = ass::token_kind::Directive;
         }
         else
@@ -423,31 +364,18 @@ restart_get:
   case '5': case '6': case '7': case '8': case '9':
     {
       // readin until there is no number anymore. Disallow 000840
-      std::string name;
-      name.push_back(ch);
       bool emit_not_a_number_error = false;
       bool emit_starts_with_zero_error = false;
-      while(col < linebuf.size())
+      while(col < linebuf.size() && !is_blank(linebuf[col]))
       {
-        // don't use get<char>() here, numbers are not connected with a '\n'
         ch = linebuf[col++];
 
-        // we look up in the operator map only for the single char. otherwise we wont parse 2; not correctly for example
-        // This could give problems with floaing point numbers since 2.3 will now be parsed as "2" "." "3" so to literals and a point
-        std::string ch_s;
-        ch_s.push_back(ch);
-        // break if we hit whitespace (or other control chars) or any other token char
-        if(std::iscntrl(ch) || std::isspace(ch))
-        {
-          col--;
-          break;
-        }
-        if(!std::isdigit(ch))
+        if(!is_digit(ch))
           emit_not_a_number_error = true;
         if(starts_with_zero && !emit_not_a_number_error)
           emit_starts_with_zero_error = true;
-        name.push_back(ch);
       }
+      const std::string_view name(linebuf.data() + beg_col, col - beg_col);
       if(emit_starts_with_zero_error)
       {
         diagnostic <<= diagnostic_db::parser::leading_zeros(source_range {module, beg_col + 1, beg_row, col + 1, row + 1 }, name);
@@ -465,9 +393,8 @@ restart_get:
   case EOF:
       kind = ass::token_kind::EndOfFile;
       opc = op_code::HALT;
-      data = "EOF";
+      data = eof;
     break;
   }
   return ass::token(kind, opc, data, {module, beg_col + 1, beg_row, col + 1, row + 1});
 }
-
@@ -2,17 +2,24 @@
 
 #include <diagnostic_db.hpp>
 #include <diagnostic.hpp>
+#include <thread_pool.hpp>
+
+#include <tsl/robin_set.h>
 
 #include <algorithm>
 #include <sstream>
+#include <utility>
 
 #include <iostream>
 
+// Existentials are told apart by their name. Statements checked by check_statements get a
+//  prefix of their own, names must not depend on what the same thread checked before.
+thread_local std::string exist_prefix = "α";
 thread_local std::size_t exist_counter = 0;
 
 struct exist : ast_base
 {
-  using ptr = std::shared_ptr<exist>;
+  using ptr = exist*;
 
   exist(symbol symb) : ast_base(ASTNodeKind::exist), symb(symb)
   {  }
@@ -23,11 +30,16 @@ struct exist : ast_base
   ast_ptr solution { nullptr };
   symbol symb;
 };
+static_assert(std::is_trivially_destructible_v<exist>, "The checker creates existentials by the thousands.");
+
+exist::ptr fresh_exist(ast_arena& arena)
+{ return arena.make<exist>(exist_prefix + std::to_string(exist_counter++)); }
 
 // ast equality
 bool eqb(ast_ptr A, ast_ptr B)
 {
-  if(A == nullptr && B == nullptr)
+  // also covers both being nullptr, and most equal types since they are hash-consed
+  if(A == B)
     return true;
   else if(A == nullptr || B == nullptr)
     return false;
@@ -48,22 +60,22 @@ bool eqb(ast_ptr A, ast_ptr B)
     } break;
 
   case ASTNodeKind::app: {
-      app::ptr a = std::static_pointer_cast<app>(A);
-      app::ptr b = std::static_pointer_cast<app>(B);
+      app::ptr a = static_cast<app*>(A);
+      app::ptr b = static_cast<app*>(B);
 
       return eqb(a->lhs, b->lhs) && eqb(a->rhs, b->rhs);
     } break;
 
   case ASTNodeKind::lambda: {
-      lambda::ptr a = std::static_pointer_cast<lambda>(A);
-      lambda::ptr b = std::static_pointer_cast<lambda>(B);
+      lambda::ptr a = static_cast<lambda*>(A);
+      lambda::ptr b = static_cast<lambda*>(B);
 
       return eqb(a->lhs, b->lhs) && eqb(a->rhs, b->rhs);
     } break;
 
   case ASTNodeKind::pattern_matcher: {
-      pattern_matcher::ptr a = std::static_pointer_cast<pattern_matcher>(A);
-      pattern_matcher::ptr b = std::static_pointer_cast<pattern_matcher>(B);
+      pattern_matcher::ptr a = static_cast<pattern_matcher*>(A);
+      pattern_matcher::ptr b = static_cast<pattern_matcher*>(B);
 
       if(!eqb(a->to_match, b->to_match))
         return false;
@@ -76,41 +88,41 @@ bool eqb(ast_ptr A, ast_ptr B)
     } break;
 
   case ASTNodeKind::match: {
-      match::ptr a = std::static_pointer_cast<match>(A);
-      match::ptr b = std::static_pointer_cast<match>(B);
+      match::ptr a = static_cast<match*>(A);
+      match::ptr b = static_cast<match*>(B);
 
       return eqb(a->pat, b->pat) && eqb(a->exp, b->exp);
     } break;
 
 
   case ASTNodeKind::expr_stmt: {
-      expr_stmt::ptr a = std::static_pointer_cast<expr_stmt>(A);
-      expr_stmt::ptr b = std::static_pointer_cast<expr_stmt>(B);
+      expr_stmt::ptr a = static_cast<expr_stmt*>(A);
+      expr_stmt::ptr b = static_cast<expr_stmt*>(B);
 
       return eqb(a->lhs, b->lhs);
     } break;
   case ASTNodeKind::assign: {
-      assign::ptr a = std::static_pointer_cast<assign>(A);
-      assign::ptr b = std::static_pointer_cast<assign>(B);
+      assign::ptr a = static_cast<assign*>(A);
+      assign::ptr b = static_cast<assign*>(B);
 
       return eqb(a->lhs, b->lhs) && eqb(a->rhs, b->rhs);
     } break;
   case ASTNodeKind::assign_type: {
-      assign_type::ptr a = std::static_pointer_cast<assign_type>(A);
-      assign_type::ptr b = std::static_pointer_cast<assign_type>(B);
+      assign_type::ptr a = static_cast<assign_type*>(A);
+      assign_type::ptr b = static_cast<assign_type*>(B);
 
       return eqb(a->lhs, b->lhs) && eqb(a->rhs, b->rhs);
     } break;
   case ASTNodeKind::assign_data: {
-      assign_data::ptr a = std::static_pointer_cast<assign_data>(A);
-      assign_data::ptr b = std::static_pointer_cast<assign_data>(B);
+      assign_data::ptr a = static_cast<assign_data*>(A);
+      assign_data::ptr b = static_cast<assign_data*>(B);
 
       return eqb(a->lhs, b->lhs) && eqb(a->rhs, b->rhs);
     } break;
 
   case ASTNodeKind::exist: {
-      exist::ptr a = std::static_pointer_cast<exist>(A);
-      exist::ptr b = std::static_pointer_cast<exist>(B);
+      exist::ptr a = static_cast<exist*>(A);
+      exist::ptr b = static_cast<exist*>(B);
 
       if(a->is_solved() && b->is_solved())
         return a->symb == b->symb && eqb(a->solution, b->solution);
@@ -123,7 +135,7 @@ bool eqb(ast_ptr A, ast_ptr B)
   return false;
 }
 
-ast_ptr subst(ast_ptr what, ast_ptr for_, ast_ptr in)
+ast_ptr subst(typing_context& ctx, ast_ptr what, ast_ptr for_, ast_ptr in)
 {
   ast_ptr to_ret = in;
   if(eqb(what, in))
@@ -137,25 +149,32 @@ ast_ptr subst(ast_ptr what, ast_ptr for_, ast_ptr in)
     default: to_ret = in; break;
 
     case ASTNodeKind::app: {
-        app::ptr a = std::static_pointer_cast<app>(in);
+        app::ptr a = static_cast<app*>(in);
 
-        auto x = subst(what, for_, a->lhs);
-        auto y = subst(what, for_, a->rhs);
+        auto x = subst(ctx, what, for_, a->lhs);
+        auto y = subst(ctx, what, for_, a->rhs);
 
-        to_ret = std::make_shared<app>(x, y);
+        // a type or annotation of its own is added below, that one can't be shared
+        if(in->type != nullptr || in->annot != nullptr)
+          to_ret = ctx.arena->make<app>(x, y);
+        else if(x != a->lhs || y != a->rhs)
+          to_ret = ctx.make_app(x, y);
       } break;
 
     case ASTNodeKind::lambda: {
-        lambda::ptr a = std::static_pointer_cast<lambda>(in);
+        lambda::ptr a = static_cast<lambda*>(in);
 
         if(a->lhs->type != nullptr)
-          a->lhs->type = subst(what, for_, a->lhs->type);
+          a->lhs->type = subst(ctx, what, for_, a->lhs->type);
         if(a->lhs->annot != nullptr)
-          a->lhs->annot = subst(what, for_, a->lhs->annot);
+          a->lhs->annot = subst(ctx, what, for_, a->lhs->annot);
 
-        auto y = subst(what, for_, a->rhs);
+        auto y = subst(ctx, what, for_, a->rhs);
 
-        to_ret = std::make_shared<lambda>(a->lhs, y);
+        if(in->type != nullptr || in->annot != nullptr)
+          to_ret = ctx.arena->make<lambda>(a->lhs, y);
+        else if(y != a->rhs)
+          to_ret = ctx.make_lambda(a->lhs, y);
       } break;
 
     case ASTNodeKind::pattern_matcher: {
@@ -168,20 +187,21 @@ ast_ptr subst(ast_ptr what, ast_ptr for_, ast_ptr in)
 
 
     case ASTNodeKind::exist: {
-        exist::ptr a = std::static_pointer_cast<exist>(in);
+        exist::ptr a = static_cast<exist*>(in);
 
-        if(a->is_solved())
-          to_ret = subst(what, for_, a->solution);
+        ast_ptr root = ctx.root_of(a);
+        if(root->kind == ASTNodeKind::exist)
+          to_ret = root;
         else
-          to_ret = a;
+          to_ret = subst(ctx, what, for_, root);
       } break;
     }
   }
 
   if(in->type != nullptr)
-    to_ret->type = subst(what, for_, in->type);
+    to_ret->type = subst(ctx, what, for_, in->type);
   if(in->annot != nullptr)
-    to_ret->annot = subst(what, for_, in->annot);
+    to_ret->annot = subst(ctx, what, for_, in->annot);
 
   return to_ret;
 }
@@ -196,15 +216,15 @@ bool has_existentials(ast_ptr a)
   case ASTNodeKind::exist: return true;
 
   case ASTNodeKind::app: {
-    app::ptr aa = std::static_pointer_cast<app>(a);
+    app::ptr aa = static_cast<app*>(a);
     return has_existentials(aa->lhs) || has_existentials(aa->rhs);
   } break;
   case ASTNodeKind::lambda: {
-    lambda::ptr al = std::static_pointer_cast<lambda>(a);
+    lambda::ptr al = static_cast<lambda*>(a);
     return has_existentials(al->lhs) || has_existentials(al->rhs);
   } break;
   case ASTNodeKind::pattern_matcher: {
-    pattern_matcher::ptr pm = std::static_pointer_cast<pattern_matcher>(a);
+    pattern_matcher::ptr pm = static_cast<pattern_matcher*>(a);
     if(has_existentials(pm->to_match))
       return true;
     for(auto& r : pm->data)
@@ -213,25 +233,25 @@ bool has_existentials(ast_ptr a)
     return false;
   } break;
   case ASTNodeKind::match: {
-    match::ptr am = std::static_pointer_cast<match>(a);
+    match::ptr am = static_cast<match*>(a);
 
     return has_existentials(am->pat) || has_existentials(am->exp);
   } break;
 
   case ASTNodeKind::expr_stmt: {
-    expr_stmt::ptr al = std::static_pointer_cast<expr_stmt>(a);
+    expr_stmt::ptr al = static_cast<expr_stmt*>(a);
     return has_existentials(al->lhs);
   } break;
   case ASTNodeKind::assign: {
-    assign::ptr al = std::static_pointer_cast<assign>(a);
+    assign::ptr al = static_cast<assign*>(a);
     return has_existentials(al->lhs) || has_existentials(al->rhs);
   } break;
   case ASTNodeKind::assign_data: {
-    assign_data::ptr al = std::static_pointer_cast<assign_data>(a);
+    assign_data::ptr al = static_cast<assign_data*>(a);
     return has_existentials(al->lhs) || has_existentials(al->rhs);
   } break;
   case ASTNodeKind::assign_type: {
-    assign_type::ptr al = std::static_pointer_cast<assign_type>(a);
+    assign_type::ptr al = static_cast<assign_type*>(a);
     return has_existentials(al->lhs) || has_existentials(al->rhs);
   } break;
   }
@@ -255,6 +275,11 @@ ast_ptr hx_ast_type_checking::find_type(typing_context& ctx, ast_ptr of)
   return A;
 }
 
+// Nodes rebuilt by typing_context::subst have no type or annotation, only nodes without one can be
+//  handed out unchanged instead.
+bool bare(ast_ptr node)
+{ return node->type == nullptr && node->annot == nullptr; }
+
 ast_ptr typing_context::subst(ast_ptr what)
 {
   if(what == nullptr)
@@ -272,25 +297,29 @@ ast_ptr typing_context::subst(ast_ptr what)
     return what;
 
   case ASTNodeKind::app: {
-      app::ptr ap = std::static_pointer_cast<app>(what);
+      app::ptr ap = static_cast<app*>(what);
       
       auto lhs = subst(ap->lhs);
       auto rhs = subst(ap->rhs);
 
-      return std::make_shared<app>(lhs, rhs);
+      if(lhs == ap->lhs && rhs == ap->rhs && bare(what))
+        return what;
+      return make_app(lhs, rhs);
     } break;
 
   case ASTNodeKind::lambda: {
-      lambda::ptr lam = std::static_pointer_cast<lambda>(what);
+      lambda::ptr lam = static_cast<lambda*>(what);
 
       auto lhs = subst(lam->lhs);
       auto rhs = subst(lam->rhs);
 
-      return std::make_shared<lambda>(lhs, rhs);
+      if(lhs == lam->lhs && rhs == lam->rhs && bare(what))
+        return what;
+      return make_lambda(lhs, rhs);
     } break;
 
   case ASTNodeKind::pattern_matcher: {
-      pattern_matcher::ptr pm = std::static_pointer_cast<pattern_matcher>(what);
+      pattern_matcher::ptr pm = static_cast<pattern_matcher*>(what);
 
       auto p = subst(pm->to_match);
 
@@ -298,24 +327,32 @@ ast_ptr typing_context::subst(ast_ptr what)
       for(auto& r : pm->data)
         arms.emplace_back(subst(r));
 
-      return std::make_shared<pattern_matcher>(p, arms);
+      if(p == pm->to_match && arms == pm->data && bare(what))
+        return what;
+      return arena->make<pattern_matcher>(p, arms);
     } break;
   
   case ASTNodeKind::match: {
-      match::ptr am = std::static_pointer_cast<match>(what);
+      match::ptr am = static_cast<match*>(what);
 
       auto lhs = subst(am->pat);
       auto rhs = subst(am->exp);
 
-      return std::make_shared<match>(lhs, rhs);
+      if(lhs == am->pat && rhs == am->exp && bare(what))
+        return what;
+      return arena->make<match>(lhs, rhs);
     } break;
 
   case ASTNodeKind::exist: {
-      exist::ptr ex = std::static_pointer_cast<exist>(what);
+      exist::ptr ex = static_cast<exist*>(what);
       
-      if(ex->is_solved())
-        return subst(ex->solution);
-      return ex;
+      ast_ptr root = root_of(ex);
+      if(root->kind == ASTNodeKind::exist)
+        return root;
+
+      // keep the applied solution, the next subst only has to look at what got solved since
+      set_solution(ex, subst(root));
+      return ex->solution;
     } break;
 
   case ASTNodeKind::assign:
@@ -327,6 +364,54 @@ ast_ptr typing_context::subst(ast_ptr what)
   return nullptr;
 }
 
+std::size_t typing_context::term_key_hash::operator()(const term_key& key) const
+{
+  const auto l = reinterpret_cast<std::uintptr_t>(key.lhs);
+  const auto r = reinterpret_cast<std::uintptr_t>(key.rhs);
+
+  std::uint64_t h = (l * 0x9E3779B97F4A7C15ULL) ^ (r + 0x632BE59BD9B4E019ULL + (l << 6) + (l >> 2));
+  h ^= static_cast<std::uint64_t>(key.kind);
+  h ^= h >> 29;
+  return static_cast<std::size_t>(h * 0xBF58476D1CE4E5B9ULL);
+}
+
+ast_ptr typing_context::make_app(ast_ptr lhs, ast_ptr rhs)
+{
+  const term_key key { ASTNodeKind::app, lhs, rhs };
+  if(auto it = consed.find(key); it != consed.end())
+    return it->second;
+
+  ast_ptr node = arena->make<app>(lhs, rhs);
+  consed.emplace(key, node);
+  return node;
+}
+
+ast_ptr typing_context::make_lambda(ast_ptr lhs, ast_ptr rhs)
+{
+  const term_key key { ASTNodeKind::lambda, lhs, rhs };
+  if(auto it = consed.find(key); it != consed.end())
+    return it->second;
+
+  ast_ptr node = arena->make<lambda>(lhs, rhs);
+  consed.emplace(key, node);
+  return node;
+}
+
+template<typename Pred>
+typing_context::pos typing_context::find(const positions* in, typing_context::pos begin, Pred pred) const
+{
+  if(in == nullptr)
+    return data.end();
+
+  const std::size_t from = begin - data.begin();
+  if(in->first >= from && pred(data[in->first]))
+    return data.begin() + in->first;
+  for(auto p : in->rest)
+    if(p >= from && pred(data[p]))
+      return data.begin() + p;
+  return data.end();
+}
+
 typing_context::pos typing_context::lookup_id(identifier::ptr id) const
 { return lookup_id(data.begin(), id); }
 
@@ -338,8 +423,10 @@ typing_context::pos typing_context::lookup_ex(ast_ptr ex) const
 
 typing_context::pos typing_context::lookup_id(typing_context::pos begin, identifier::ptr id) const
 {
-  return std::find_if(begin, data.end(), [id]
-      (auto& elem) { return eqb(elem.id_def, id) && elem.type != nullptr && elem.existential == nullptr; });
+  // identifiers are equal if they have the same binding occurence, see eqb
+  auto it = ids.find(id);
+  return find(it == ids.end() ? nullptr : &it->second, begin, []
+      (auto& elem) { return elem.type != nullptr && elem.existential == nullptr; });
 }
 
 typing_context::pos typing_context::lookup_type(typing_context::pos begin, ast_ptr type) const
@@ -350,17 +437,279 @@ typing_context::pos typing_context::lookup_type(typing_context::pos begin, ast_p
 
 typing_context::pos typing_context::lookup_ex(typing_context::pos begin, ast_ptr ex) const
 {
-  return std::find_if(begin, data.end(), [ex]
+  if(ex == nullptr || ex->kind != ASTNodeKind::exist)
+    return data.end();
+
+  // existentials of the same name still differ if only one of them is solved
+  auto it = exs.find(static_cast<exist*>(ex)->symb);
+  return find(it == exs.end() ? nullptr : &it->second, begin, [ex]
       (auto& elem) { return elem.id_def == nullptr && elem.type == nullptr && eqb(elem.existential, ex); });
 }
 
+void typing_context::push(CTXElement elem)
+{
+  if(saved > 0)
+    trail.push_back({ change::pushed, data.size(), 0, nullptr, nullptr });
+  data.push_back(elem);
+  if(auto idx = index_of(data.back()))
+    idx->add(data.size() - 1);
+}
+
+typing_context::pos typing_context::insert(typing_context::pos before, CTXElement elem)
+{
+  const std::size_t at = before - data.begin();
+  if(saved > 0)
+    trail.push_back({ change::inserted, at, 0, nullptr, nullptr });
+
+  // everything behind moves up by one, from the back so the positions stay ascending
+  for(std::size_t p = data.size(); p-- > at; )
+    if(auto idx = index_of(data[p]))
+      idx->shift(p);
+
+  auto it = data.insert(before, elem);
+  if(auto idx = index_of(*it))
+    idx->add(at);
+  return it;
+}
+
+void typing_context::truncate(typing_context::pos from)
+{
+  const std::size_t at = from - data.begin();
+  if(saved > 0 && from != data.end())
+  {
+    trail.push_back({ change::truncated, at, data.size() - at, nullptr, nullptr });
+    dropped.insert(dropped.end(), from, data.cend());
+  }
+
+  for(std::size_t p = data.size(); p-- > at; )
+  {
+    const CTXElement& elem = data[p];
+    if(auto idx = index_of(elem); idx != nullptr && idx->remove(p))
+    {
+      if(elem.existential != nullptr)
+        exs.erase(elem.existential->symb);
+      else
+        ids.erase(elem.id_def);
+    }
+  }
+  data.erase(from, data.end());
+}
+
+void typing_context::clear()
+{
+  if(saved > 0)
+    return truncate(data.begin());
+
+  data.clear();
+  ids.clear();
+  exs.clear();
+}
+
+ast_ptr typing_context::root_of(exist* ex)
+{
+  ast_ptr root = ex;
+  while(root->kind == ASTNodeKind::exist && static_cast<exist*>(root)->is_solved())
+    root = static_cast<exist*>(root)->solution;
+
+  for(ast_ptr at = ex; at != root; )
+  {
+    exist::ptr on = static_cast<exist*>(at);
+    at = on->solution;
+    if(at != root)
+      set_solution(on, root);
+  }
+  return root;
+}
+
+namespace
+{
+
+// Whether `ex` is part of `in`, through solutions and the types of nodes as well, which is where
+//  subst looks.
+bool occurs(const exist* ex, ast_ptr in, tsl::robin_set<const ast_base*>& seen)
+{
+  if(in == nullptr || !seen.insert(in).second)
+    return false;
+  if(in == ex)
+    return true;
+
+  switch(in->kind)
+  {
+  default: break;
+
+  case ASTNodeKind::exist:
+    if(occurs(ex, static_cast<exist*>(in)->solution, seen))
+      return true;
+    break;
+  case ASTNodeKind::app:
+    if(occurs(ex, static_cast<app*>(in)->lhs, seen) || occurs(ex, static_cast<app*>(in)->rhs, seen))
+      return true;
+    break;
+  case ASTNodeKind::lambda:
+    if(occurs(ex, static_cast<lambda*>(in)->lhs, seen) || occurs(ex, static_cast<lambda*>(in)->rhs, seen))
+      return true;
+    break;
+  case ASTNodeKind::match:
+    if(occurs(ex, static_cast<match*>(in)->pat, seen) || occurs(ex, static_cast<match*>(in)->exp, seen))
+      return true;
+    break;
+  case ASTNodeKind::pattern_matcher: {
+      pattern_matcher::ptr pm = static_cast<pattern_matcher*>(in);
+      if(occurs(ex, pm->to_match, seen))
+        return true;
+      for(auto& r : pm->data)
+        if(occurs(ex, r, seen))
+          return true;
+    } break;
+  }
+  return occurs(ex, in->type, seen) || occurs(ex, in->annot, seen);
+}
+
+bool occurs(const exist* ex, ast_ptr in)
+{
+  tsl::robin_set<const ast_base*> seen;
+  return occurs(ex, in, seen);
+}
+
+}
+
+void typing_context::solve(exist* ex, ast_ptr with)
+{
+  ast_ptr root = root_of(ex);
+  if(with->kind == ASTNodeKind::exist)
+    with = root_of(static_cast<exist*>(with));
+  if(with == root)
+    return;
+
+  // An existential solved a second time only changes its own solution, as it always did. The
+  //  same goes for a root that would end up in its own solution, a cyclic solution sends subst
+  //  into an endless recursion. An existential that can't be solved without one stays unsolved,
+  //  checking reports it as such.
+  exist::ptr target = root->kind == ASTNodeKind::exist ? static_cast<exist*>(root) : ex;
+  if(target != ex && occurs(target, with))
+    target = ex;
+  if(!occurs(target, with))
+    set_solution(target, with);
+}
+
+void typing_context::set_solution(exist* ex, ast_ptr solution)
+{
+  if(saved > 0)
+    trail.push_back({ change::solved, 0, 0, ex, ex->solution });
+  ex->solution = solution;
+}
+
+typing_context::snapshot typing_context::save()
+{
+  ++saved;
+  return { trail.size() };
+}
+
+void typing_context::rollback(typing_context::snapshot to)
+{
+  // undoing is not logged itself
+  const std::size_t outer = std::exchange(saved, 0) - 1;
+  while(trail.size() > to.trail)
+  {
+    const change c = trail.back();
+    trail.pop_back();
+
+    switch(c.kind)
+    {
+    case change::pushed:
+      truncate(data.begin() + c.at);
+      break;
+    case change::inserted: {
+        std::vector<CTXElement> behind(data.begin() + c.at + 1, data.end());
+        truncate(data.begin() + c.at);
+        for(auto& elem : behind)
+          push(elem);
+      } break;
+    case change::truncated: {
+        for(auto it = dropped.end() - c.count; it != dropped.end(); ++it)
+          push(*it);
+        dropped.erase(dropped.end() - c.count, dropped.end());
+      } break;
+    case change::solved:
+      c.ex->solution = c.solution;
+      break;
+    }
+  }
+  saved = outer;
+  if(saved == 0)
+    dropped.clear();
+}
+
+void typing_context::keep(typing_context::snapshot s)
+{
+  // an outer snapshot may still be rolled back, it needs the log
+  if(--saved == 0)
+  {
+    trail.clear();
+    dropped.clear();
+  }
+}
+
+typing_context::pos typing_context::begin() const
+{ return data.begin(); }
+
+typing_context::pos typing_context::end() const
+{ return data.end(); }
+
+std::size_t typing_context::size() const
+{ return data.size(); }
+
+typing_context::positions* typing_context::index_of(const CTXElement& elem)
+{
+  if(elem.existential != nullptr)
+    return &exs[elem.existential->symb];
+  if(elem.id_def != nullptr)
+    return &ids[elem.id_def];
+  return nullptr;
+}
+
+void typing_context::positions::add(std::size_t p)
+{
+  if(first == npos)
+    first = p;
+  else if(p < first)
+  {
+    rest.insert(rest.begin(), first);
+    first = p;
+  }
+  else
+    rest.insert(std::upper_bound(rest.begin(), rest.end(), p), p);
+}
+
+bool typing_context::positions::remove(std::size_t p)
+{
+  if(first != p)
+    rest.erase(std::find(rest.begin(), rest.end(), p));
+  else if(rest.empty())
+    first = npos;
+  else
+  {
+    first = rest.front();
+    rest.erase(rest.begin());
+  }
+  return first == npos;
+}
+
+void typing_context::positions::shift(std::size_t p)
+{
+  if(first == p)
+    ++first;
+  else
+    ++*std::find(rest.begin(), rest.end(), p);
+}
+
 bool hx_ast_type_checking::check(typing_context& ctx, ast_ptr what, ast_ptr type) 
 {
   switch(what->kind)
   {
   // C-Match
   case ASTNodeKind::match: {
-      auto mm = std::static_pointer_cast<match>(what);
+      auto mm = static_cast<match*>(what);
 
       checking_pattern = true;
       if(!check(ctx, mm->pat, type))
@@ -376,19 +725,19 @@ bool hx_ast_type_checking::check(typing_context& ctx, ast_ptr what, ast_ptr type
     } break;
   // C-Underscore
   case ASTNodeKind::identifier: {
-      auto the_id = std::static_pointer_cast<identifier>(what);
+      auto the_id = static_cast<identifier*>(what);
 
       if(the_id->symb == symbol("_"))
         return true; // If the symbol is an underscore, we refine, i.e. it doesn't matter
       if(checking_pattern) {
-        auto it = ctx.lookup_id(std::static_pointer_cast<identifier>(what));
+        auto it = ctx.lookup_id(static_cast<identifier*>(what));
 
-        if(it != ctx.data.end()) {
+        if(it != ctx.end()) {
           goto c_sub;
         }
         else {
           // we check a pattern, any free variable is implicitly bound!
-          ctx.data.emplace_back(CTXElement { the_id, type });
+          ctx.push({ the_id, type });
 
           return true;
         }
@@ -399,8 +748,8 @@ bool hx_ast_type_checking::check(typing_context& ctx, ast_ptr what, ast_ptr type
   case ASTNodeKind::lambda: {
       if(type->kind == ASTNodeKind::lambda)
       {
-        lambda::ptr pi  = std::static_pointer_cast<lambda>(type);
-        lambda::ptr lam = std::static_pointer_cast<lambda>(what);
+        lambda::ptr pi  = static_cast<lambda*>(type);
+        lambda::ptr lam = static_cast<lambda*>(what);
 
         if(pi->lhs->annot != nullptr && pi->lhs->type == nullptr)
           pi->lhs->type = pi->lhs->annot;
@@ -419,13 +768,13 @@ bool hx_ast_type_checking::check(typing_context& ctx, ast_ptr what, ast_ptr type
 
           return false;
         }
-        ctx.data.emplace_back(CTXElement { std::static_pointer_cast<identifier>(lam->lhs), pi->lhs->type });
+        ctx.push({ static_cast<identifier*>(lam->lhs), pi->lhs->type });
 
         if(!check(ctx, lam->rhs, pi->rhs))
           return false;
         lam->lhs->type = ctx.subst(pi->lhs->type);
         lam->rhs->type = ctx.subst(pi->rhs->type);
-        ctx.data.erase(ctx.lookup_id(std::static_pointer_cast<identifier>(lam->lhs)), ctx.data.end());
+        ctx.truncate(ctx.lookup_id(static_cast<identifier*>(lam->lhs)));
         return true;
       }
       goto c_sub;
@@ -472,8 +821,8 @@ ast_ptr hx_ast_type_checking::synthesize(typing_context& ctx, ast_ptr what)
   {
   // S-Ident
   case ASTNodeKind::identifier: {
-      auto it = ctx.lookup_id(std::static_pointer_cast<identifier>(what));
-      if(it == ctx.data.end())
+      auto it = ctx.lookup_id(static_cast<identifier*>(what));
+      if(it == ctx.end())
       {
         std::stringstream a;
         hx_ast::print(a, what);
@@ -486,7 +835,7 @@ ast_ptr hx_ast_type_checking::synthesize(typing_context& ctx, ast_ptr what)
 
   // S-App
   case ASTNodeKind::app: {
-      app::ptr aa = std::static_pointer_cast<app>(what);
+      app::ptr aa = static_cast<app*>(what);
 
       auto A = synthesize(ctx, aa->lhs);
       if(A == nullptr)
@@ -501,14 +850,14 @@ ast_ptr hx_ast_type_checking::synthesize(typing_context& ctx, ast_ptr what)
 
   // S-Lambda
   case ASTNodeKind::lambda: {
-      lambda::ptr lam = std::static_pointer_cast<lambda>(what);
+      lambda::ptr lam = static_cast<lambda*>(what);
 
-      auto alpha1 = std::make_shared<exist>("α" + std::to_string(exist_counter++));
-      auto alpha2 = std::make_shared<exist>("α" + std::to_string(exist_counter++));
+      auto alpha1 = fresh_exist(*ctx.arena);
+      auto alpha2 = fresh_exist(*ctx.arena);
 
-      ctx.data.emplace_back(alpha2);
-      ctx.data.emplace_back(alpha1);
-      ctx.data.emplace_back(std::static_pointer_cast<identifier>(lam->lhs), alpha1);
+      ctx.push(alpha2);
+      ctx.push(alpha1);
+      ctx.push({ static_cast<identifier*>(lam->lhs), alpha1 });
 
       if(lam->lhs->annot != nullptr && lam->lhs->type == nullptr)
         lam->lhs->type = lam->lhs->annot;
@@ -527,17 +876,17 @@ ast_ptr hx_ast_type_checking::synthesize(typing_context& ctx, ast_ptr what)
 
       if(!check(ctx, lam->rhs, alpha2))
         return nullptr;
-      ctx.data.erase(ctx.lookup_id(std::static_pointer_cast<identifier>(lam->lhs)), ctx.data.end());
+      ctx.truncate(ctx.lookup_id(static_cast<identifier*>(lam->lhs)));
 
       lam->lhs->type = ctx.subst(alpha1);
       lam->rhs->type = ctx.subst(alpha2);
 
-      return what->type = std::make_shared<lambda>(lam->lhs, lam->rhs->type);
+      return what->type = ctx.make_lambda(lam->lhs, lam->rhs->type);
     } break;
 
   // S-Case
   case ASTNodeKind::pattern_matcher: {
-      pattern_matcher::ptr pm = std::static_pointer_cast<pattern_matcher>(what);
+      pattern_matcher::ptr pm = static_cast<pattern_matcher*>(what);
 
       auto A = synthesize(ctx, pm->to_match);
       if(A == nullptr)
@@ -551,12 +900,12 @@ ast_ptr hx_ast_type_checking::synthesize(typing_context& ctx, ast_ptr what)
 
   // S-Assign   /   S-OracleAssign
   case ASTNodeKind::assign: {
-      assign::ptr as = std::static_pointer_cast<assign>(what);
+      assign::ptr as = static_cast<assign*>(what);
 
       if(as->lhs->annot != nullptr)
       {
         // TODO: check if annotation is wellformed
-        ctx.data.emplace_back(std::static_pointer_cast<identifier>(as->lhs), as->lhs->annot);
+        ctx.push({ static_cast<identifier*>(as->lhs), as->lhs->annot });
 
         if(!check(ctx, as->rhs, as->lhs->annot))
           return nullptr;
@@ -567,26 +916,26 @@ ast_ptr hx_ast_type_checking::synthesize(typing_context& ctx, ast_ptr what)
       if(A == nullptr)
         return nullptr;
 
-      ctx.data.emplace_back(std::static_pointer_cast<identifier>(as->lhs), A);
+      ctx.push({ static_cast<identifier*>(as->lhs), A });
       return what->type = A;
     } break;
   // S-AssignData
   case ASTNodeKind::assign_data: {
-      assign_data::ptr as = std::static_pointer_cast<assign_data>(what);
+      assign_data::ptr as = static_cast<assign_data*>(what);
       // TODO: check wellformedness
-      ctx.data.emplace_back(std::static_pointer_cast<identifier>(as->lhs), as->rhs);
+      ctx.push({ static_cast<identifier*>(as->lhs), as->rhs });
       return what->type = as->rhs;
     } break;
   // S-AssignType
   case ASTNodeKind::assign_type: {
-      assign_type::ptr as = std::static_pointer_cast<assign_type>(what);
+      assign_type::ptr as = static_cast<assign_type*>(what);
       // TODO: check wellformedness
-      ctx.data.emplace_back(std::static_pointer_cast<identifier>(as->lhs), as->rhs);
+      ctx.push({ static_cast<identifier*>(as->lhs), as->rhs });
       return what->type = as->rhs;
     } break;
   // S-ExprStmt
   case ASTNodeKind::expr_stmt: {
-      expr_stmt::ptr ex = std::static_pointer_cast<expr_stmt>(what);
+      expr_stmt::ptr ex = static_cast<expr_stmt*>(what);
 
       return what->type = synthesize(ctx, ex->lhs);
     } break;
@@ -601,25 +950,25 @@ ast_ptr hx_ast_type_checking::eta_synthesize(typing_context& ctx, ast_ptr A, ast
   {
   // >=>-Exist
   case ASTNodeKind::exist: {
-      exist::ptr ex = std::static_pointer_cast<exist>(A);
+      exist::ptr ex = static_cast<exist*>(A);
 
       auto ex_it = ctx.lookup_ex(ex);
-      if(ex_it == ctx.data.end())
+      if(ex_it == ctx.end())
       {
         diagnostic <<= diagnostic_db::sema::existential_not_in_context(source_range {  }, ex->symb.get_string());
         return nullptr;
       }
 
-      exist::ptr alpha1 = std::make_shared<exist>("α" + std::to_string(exist_counter++));
-      exist::ptr alpha2 = std::make_shared<exist>("α" + std::to_string(exist_counter++));
+      exist::ptr alpha1 = fresh_exist(*ctx.arena);
+      exist::ptr alpha2 = fresh_exist(*ctx.arena);
 
       // update context
-      ctx.data.insert(ex_it, alpha1);
-      ctx.data.insert(ex_it, alpha2);
+      ex_it = ctx.insert(ex_it, alpha1);
+      ctx.insert(ex_it, alpha2);
 
-      identifier::ptr lamid = std::make_shared<identifier>("_");
+      identifier::ptr lamid = ctx.arena->make<identifier>("_");
       lamid->type = alpha1;
-      ex->solution = std::make_shared<lambda>(lamid, alpha2);
+      ctx.solve(ex, ctx.arena->make<lambda>(lamid, alpha2));
 
       if(!check(ctx, e, alpha1))
         return nullptr;
@@ -627,7 +976,7 @@ ast_ptr hx_ast_type_checking::eta_synthesize(typing_context& ctx, ast_ptr A, ast
     } break;
   // >=>-Lam
   case ASTNodeKind::lambda: {
-      lambda::ptr lam = std::static_pointer_cast<lambda>(A);
+      lambda::ptr lam = static_cast<lambda*>(A);
 
       if(lam->lhs->annot != nullptr && lam->lhs->type == nullptr)
         lam->lhs->type = lam->lhs->annot;
@@ -637,7 +986,7 @@ ast_ptr hx_ast_type_checking::eta_synthesize(typing_context& ctx, ast_ptr A, ast
 
       // TODO: make substitution/execution more efficient.
       // TODO: reduce e to a value.....?
-      return subst(lam->lhs, e, lam->rhs);
+      return subst(ctx, lam->lhs, e, lam->rhs);
     } break;
 
   default: {
@@ -669,8 +1018,8 @@ bool hx_ast_type_checking::is_subtype(typing_context& ctx, ast_ptr A, ast_ptr B)
       if(B->kind != ASTNodeKind::app)
         return false;
 
-      app::ptr aa = std::static_pointer_cast<app>(A);
-      app::ptr ba = std::static_pointer_cast<app>(B);
+      app::ptr aa = static_cast<app*>(A);
+      app::ptr ba = static_cast<app*>(B);
 
       return is_subtype(ctx, aa->lhs, ba->lhs) && is_subtype(ctx, aa->rhs, ba->rhs);
     } break;
@@ -679,8 +1028,8 @@ bool hx_ast_type_checking::is_subtype(typing_context& ctx, ast_ptr A, ast_ptr B)
       if(B->kind != ASTNodeKind::lambda)
         return false;
 
-      lambda::ptr al = std::static_pointer_cast<lambda>(A);
-      lambda::ptr bl = std::static_pointer_cast<lambda>(B);
+      lambda::ptr al = static_cast<lambda*>(A);
+      lambda::ptr bl = static_cast<lambda*>(B);
 
       if(al->lhs->annot != nullptr && al->lhs->type == nullptr)
         al->lhs->type = al->lhs->annot;
@@ -696,8 +1045,8 @@ def:
       if(A->kind == ASTNodeKind::exist && B->kind == ASTNodeKind::exist)
       {
         // <:-Exist
-        exist::ptr ae = std::static_pointer_cast<exist>(A);
-        exist::ptr be = std::static_pointer_cast<exist>(B);
+        exist::ptr ae = static_cast<exist*>(A);
+        exist::ptr be = static_cast<exist*>(B);
         if(ae->is_solved() || be->is_solved())
           return is_subtype(ctx, ctx.subst(ae), ctx.subst(be));
 
@@ -707,8 +1056,8 @@ def:
           auto alpha_it = ctx.lookup_ex(A);
           auto beta_it  = ctx.lookup_ex(B);
 
-          assert(alpha_it != ctx.data.end() && "ae must appear in the context.");
-          assert(beta_it != ctx.data.end() && "be must appear in the context.");
+          assert(alpha_it != ctx.end() && "ae must appear in the context.");
+          assert(beta_it != ctx.end() && "be must appear in the context.");
 
           if(alpha_it < beta_it)
             return inst_l(ctx, ae, B);
@@ -734,7 +1083,7 @@ def:
           diagnostic <<= diagnostic_db::sema::free_var_in_type(source_range { }, a.str(), b.str());
           return false;
         }
-        return inst_l(ctx, std::static_pointer_cast<exist>(A), B);
+        return inst_l(ctx, static_cast<exist*>(A), B);
       }
       else if(A->kind != ASTNodeKind::exist && B->kind == ASTNodeKind::exist)
       {
@@ -749,7 +1098,7 @@ def:
           diagnostic <<= diagnostic_db::sema::free_var_in_type(source_range { }, a.str(), b.str());
           return false;
         }
-        return inst_r(ctx, A, std::static_pointer_cast<exist>(B));
+        return inst_r(ctx, A, static_cast<exist*>(B));
       }
       return false; // <- TODO: emit diagnostic
     } break;
@@ -762,59 +1111,59 @@ bool hx_ast_type_checking::inst_l(typing_context& ctx, exist::ptr alpha, ast_ptr
   {
   // <=L-Exist
   case ASTNodeKind::exist: {
-      exist::ptr beta = std::static_pointer_cast<exist>(A);
+      exist::ptr beta = static_cast<exist*>(A);
 
       auto alpha_it = ctx.lookup_ex(alpha);
       auto beta_it  = ctx.lookup_ex(alpha_it, beta);
 
-      if(alpha_it == ctx.data.end())
+      if(alpha_it == ctx.end())
       {
         diagnostic <<= diagnostic_db::sema::existential_not_in_context(source_range{}, alpha->symb.get_string());
         return false;
       }
-      if(beta_it == ctx.data.end())
+      if(beta_it == ctx.end())
       {
         diagnostic <<= diagnostic_db::sema::existential_not_in_context(source_range{}, beta->symb.get_string());
         return false;
       }
-      beta->solution = alpha;
+      ctx.solve(beta, alpha);
       return true;
     } break;
   // <=L-Lambda
   case ASTNodeKind::lambda: {
       auto alpha_it = ctx.lookup_ex(alpha);
-      if(alpha_it == ctx.data.end())
+      if(alpha_it == ctx.end())
       {
         diagnostic <<= diagnostic_db::sema::existential_not_in_context(source_range{}, alpha->symb.get_string());
         return false;
       }
-      lambda::ptr lam = std::static_pointer_cast<lambda>(A);
+      lambda::ptr lam = static_cast<lambda*>(A);
       if(lam->lhs->annot != nullptr && lam->lhs->type == nullptr)
         lam->lhs->type = lam->lhs->annot;
       
-      auto alpha1 = std::make_shared<exist>("α" + std::to_string(exist_counter++));
-      auto alpha2 = std::make_shared<exist>("α" + std::to_string(exist_counter++));
+      auto alpha1 = fresh_exist(*ctx.arena);
+      auto alpha2 = fresh_exist(*ctx.arena);
 
-      alpha_it = ctx.data.insert(alpha_it, alpha1);
-      alpha_it = ctx.data.insert(alpha_it, alpha2);
+      alpha_it = ctx.insert(alpha_it, alpha1);
+      alpha_it = ctx.insert(alpha_it, alpha2);
 
 
       bool fst = is_subtype(ctx, lam->lhs->type, alpha1);
       bool snd = is_subtype(ctx, alpha2, ctx.subst(lam->rhs));
       
       lam->lhs->type = ctx.subst(alpha1);
-      alpha->solution = std::make_shared<lambda>(lam->lhs, ctx.subst(alpha2));
+      ctx.solve(alpha, ctx.make_lambda(lam->lhs, ctx.subst(alpha2)));
       return fst && snd;
     } break;
   // <=L-Solve
   default: {
-      if(ctx.lookup_ex(alpha) == ctx.data.end())
+      if(ctx.lookup_ex(alpha) == ctx.end())
       {
         // TODO: fix source_range
         diagnostic <<= diagnostic_db::sema::existential_not_in_context(source_range{}, alpha->symb.get_string());
         return false;
       }
-      alpha->solution = A;
+      ctx.solve(alpha, A);
       return true;
     } break;
   }
@@ -826,62 +1175,457 @@ bool hx_ast_type_checking::inst_r(typing_context& ctx, ast_ptr A, exist::ptr alp
   {
   // <=R-Exist
   case ASTNodeKind::exist: {
-      exist::ptr beta = std::static_pointer_cast<exist>(A);
+      exist::ptr beta = static_cast<exist*>(A);
 
       auto alpha_it = ctx.lookup_ex(alpha);
       auto beta_it  = ctx.lookup_ex(alpha_it, beta);
 
-      if(alpha_it == ctx.data.end())
+      if(alpha_it == ctx.end())
       {
         diagnostic <<= diagnostic_db::sema::existential_not_in_context(source_range{}, alpha->symb.get_string());
         return false;
       }
-      if(beta_it == ctx.data.end())
+      if(beta_it == ctx.end())
       {
         diagnostic <<= diagnostic_db::sema::existential_not_in_context(source_range{}, beta->symb.get_string());
         return false;
       }
-      beta->solution = alpha;
+      ctx.solve(beta, alpha);
       return true;
     } break;
   // <=R-Lambda
   case ASTNodeKind::lambda: {
       auto alpha_it = ctx.lookup_ex(alpha);
-      if(alpha_it == ctx.data.end())
+      if(alpha_it == ctx.end())
       {
         diagnostic <<= diagnostic_db::sema::existential_not_in_context(source_range{}, alpha->symb.get_string());
         return false;
       }
-      lambda::ptr lam = std::static_pointer_cast<lambda>(A);
+      lambda::ptr lam = static_cast<lambda*>(A);
       if(lam->lhs->annot != nullptr && lam->lhs->type == nullptr)
         lam->lhs->type = lam->lhs->annot;
       
-      auto alpha1 = std::make_shared<exist>("α" + std::to_string(exist_counter++));
-      auto alpha2 = std::make_shared<exist>("α" + std::to_string(exist_counter++));
+      auto alpha1 = fresh_exist(*ctx.arena);
+      auto alpha2 = fresh_exist(*ctx.arena);
 
-      alpha_it = ctx.data.insert(alpha_it, alpha1);
-      alpha_it = ctx.data.insert(alpha_it, alpha2);
+      alpha_it = ctx.insert(alpha_it, alpha1);
+      alpha_it = ctx.insert(alpha_it, alpha2);
 
 
       bool fst = is_subtype(ctx, lam->lhs->type, alpha1);
       bool snd = is_subtype(ctx, alpha2, ctx.subst(lam->rhs));
 
       lam->lhs->type = ctx.subst(alpha1);
-      alpha->solution = std::make_shared<lambda>(lam->lhs, ctx.subst(alpha2));
+      ctx.solve(alpha, ctx.make_lambda(lam->lhs, ctx.subst(alpha2)));
 
       return fst && snd;
     } break;
   // <=R-Solve
   default: {
-      if(ctx.lookup_ex(alpha) == ctx.data.end())
+      if(ctx.lookup_ex(alpha) == ctx.end())
       {
         // TODO: fix source_range
         diagnostic <<= diagnostic_db::sema::existential_not_in_context(source_range{}, alpha->symb.get_string());
         return false;
       }
-      alpha->solution = A;
+      ctx.solve(alpha, A);
       return true;
     } break;
   }
 }
 
+
+namespace
+{
+
+// Copies terms node by node. Every node is copied only once, so terms that shared a node share
+//  its copy and identifiers stay bound to the copy of their binding occurence.
+struct term_copier
+{
+  ast_ptr operator()(ast_ptr node)
+  {
+    if(node == nullptr)
+      return nullptr;
+    if(auto it = copies.find(node); it != copies.end())
+      return it->second;
+
+    ast_ptr copy;
+    switch(node->kind)
+    {
+    case ASTNodeKind::exist:           copy = arena.make<exist>(static_cast<const exist&>(*node)); break;
+    case ASTNodeKind::undef:           copy = arena.make<ast_base>(*node); break;
+    case ASTNodeKind::Kind:            copy = arena.make<kind>(static_cast<const kind&>(*node)); break;
+    case ASTNodeKind::Type:            copy = arena.make<type>(static_cast<const type&>(*node)); break;
+    case ASTNodeKind::Prop:            copy = arena.make<prop>(static_cast<const prop&>(*node)); break;
+    case ASTNodeKind::unit:            copy = arena.make<unit>(static_cast<const unit&>(*node)); break;
+    case ASTNodeKind::app:             copy = arena.make<app>(static_cast<const app&>(*node)); break;
+    case ASTNodeKind::lambda:          copy = arena.make<lambda>(static_cast<const lambda&>(*node)); break;
+    case ASTNodeKind::match:           copy = arena.make<match>(static_cast<const match&>(*node)); break;
+    case ASTNodeKind::pattern_matcher: copy = arena.make<pattern_matcher>(static_cast<const pattern_matcher&>(*node)); break;
+    case ASTNodeKind::identifier:      copy = arena.make<identifier>(static_cast<const identifier&>(*node)); break;
+    case ASTNodeKind::assign:          copy = arena.make<assign>(static_cast<const assign&>(*node)); break;
+    case ASTNodeKind::assign_type:     copy = arena.make<assign_type>(static_cast<const assign_type&>(*node)); break;
+    case ASTNodeKind::assign_data:     copy = arena.make<assign_data>(static_cast<const assign_data&>(*node)); break;
+    case ASTNodeKind::expr_stmt:       copy = arena.make<expr_stmt>(static_cast<const expr_stmt&>(*node)); break;
+    }
+    // registered before the children are copied, a node can reach itself through its type
+    copies.emplace(node, copy);
+
+    switch(copy->kind)
+    {
+    default: break;
+
+    case ASTNodeKind::exist: {
+        exist::ptr ex = static_cast<exist*>(copy);
+        ex->solution = (*this)(ex->solution);
+      } break;
+    case ASTNodeKind::app: {
+        app::ptr ap = static_cast<app*>(copy);
+        ap->lhs = (*this)(ap->lhs);
+        ap->rhs = (*this)(ap->rhs);
+      } break;
+    case ASTNodeKind::lambda: {
+        lambda::ptr lam = static_cast<lambda*>(copy);
+        lam->lhs = (*this)(lam->lhs);
+        lam->rhs = (*this)(lam->rhs);
+      } break;
+    case ASTNodeKind::match: {
+        match::ptr mm = static_cast<match*>(copy);
+        mm->pat = (*this)(mm->pat);
+        mm->exp = (*this)(mm->exp);
+      } break;
+    case ASTNodeKind::pattern_matcher: {
+        pattern_matcher::ptr pm = static_cast<pattern_matcher*>(copy);
+        pm->to_match = (*this)(pm->to_match);
+        for(auto& r : pm->data)
+          r = (*this)(r);
+      } break;
+    case ASTNodeKind::assign: {
+        assign::ptr as = static_cast<assign*>(copy);
+        as->lhs = (*this)(as->lhs);
+        as->rhs = (*this)(as->rhs);
+      } break;
+    case ASTNodeKind::assign_type: {
+        assign_type::ptr as = static_cast<assign_type*>(copy);
+        as->lhs = (*this)(as->lhs);
+        as->rhs = (*this)(as->rhs);
+      } break;
+    case ASTNodeKind::assign_data: {
+        assign_data::ptr as = static_cast<assign_data*>(copy);
+        as->lhs = (*this)(as->lhs);
+        as->rhs = (*this)(as->rhs);
+      } break;
+    case ASTNodeKind::expr_stmt: {
+        expr_stmt::ptr ex = static_cast<expr_stmt*>(copy);
+        ex->lhs = (*this)(ex->lhs);
+      } break;
+    }
+    copy->type = (*this)(copy->type);
+    copy->annot = (*this)(copy->annot);
+
+    return copy;
+  }
+
+  CTXElement element(const CTXElement& elem)
+  {
+    CTXElement copy = elem;
+    copy.existential = static_cast<exist*>((*this)(elem.existential));
+    copy.id_def = static_cast<identifier*>((*this)(elem.id_def));
+    copy.type = (*this)(elem.type);
+    return copy;
+  }
+
+  ast_arena& arena;
+  tsl::robin_map<const ast_base*, ast_ptr> copies;
+};
+
+// Adds the top-level statements `node` refers to, found by the identity of their binding
+//  occurence, the parser lets every use of a name point to it.
+void collect_dependencies(ast_ptr node, const tsl::robin_map<const ast_base*, std::size_t>& binders,
+                          tsl::robin_set<const ast_base*>& seen, std::vector<std::size_t>& deps)
+{
+  if(node == nullptr || !seen.insert(node).second)
+    return;
+
+  if(auto it = binders.find(node); it != binders.end())
+  {
+    // the annotation of a binder belongs to its own statement
+    deps.push_back(it->second);
+    return;
+  }
+
+  switch(node->kind)
+  {
+  default: break;
+
+  case ASTNodeKind::app: {
+      app::ptr ap = static_cast<app*>(node);
+      collect_dependencies(ap->lhs, binders, seen, deps);
+      collect_dependencies(ap->rhs, binders, seen, deps);
+    } break;
+  case ASTNodeKind::lambda: {
+      lambda::ptr lam = static_cast<lambda*>(node);
+      collect_dependencies(lam->lhs, binders, seen, deps);
+      collect_dependencies(lam->rhs, binders, seen, deps);
+    } break;
+  case ASTNodeKind::match: {
+      match::ptr mm = static_cast<match*>(node);
+      collect_dependencies(mm->pat, binders, seen, deps);
+      collect_dependencies(mm->exp, binders, seen, deps);
+    } break;
+  case ASTNodeKind::pattern_matcher: {
+      pattern_matcher::ptr pm = static_cast<pattern_matcher*>(node);
+      collect_dependencies(pm->to_match, binders, seen, deps);
+      for(auto& r : pm->data)
+        collect_dependencies(r, binders, seen, deps);
+    } break;
+  case ASTNodeKind::assign: {
+      assign::ptr as = static_cast<assign*>(node);
+      collect_dependencies(as->lhs->annot, binders, seen, deps);
+      collect_dependencies(as->rhs, binders, seen, deps);
+    } break;
+  case ASTNodeKind::assign_type: {
+      assign_type::ptr as = static_cast<assign_type*>(node);
+      collect_dependencies(as->rhs, binders, seen, deps);
+    } break;
+  case ASTNodeKind::assign_data: {
+      assign_data::ptr as = static_cast<assign_data*>(node);
+      collect_dependencies(as->rhs, binders, seen, deps);
+    } break;
+  case ASTNodeKind::expr_stmt: {
+      expr_stmt::ptr ex = static_cast<expr_stmt*>(node);
+      collect_dependencies(ex->lhs, binders, seen, deps);
+    } break;
+  }
+  collect_dependencies(node->type, binders, seen, deps);
+  collect_dependencies(node->annot, binders, seen, deps);
+}
+
+// The statement every top-level binder belongs to.
+tsl::robin_map<const ast_base*, std::size_t> top_level_binders(const hx_ast& ast)
+{
+  tsl::robin_map<const ast_base*, std::size_t> binders;
+  for(std::size_t i = 0; i < ast.data.size(); ++i)
+  {
+    ast_ptr root = ast.data[i];
+    switch(root->kind)
+    {
+    default: break;
+
+    case ASTNodeKind::assign:      binders.emplace(static_cast<assign*>(root)->lhs, i); break;
+    case ASTNodeKind::assign_type: binders.emplace(static_cast<assign_type*>(root)->lhs, i); break;
+    case ASTNodeKind::assign_data: binders.emplace(static_cast<assign_data*>(root)->lhs, i); break;
+    }
+  }
+  return binders;
+}
+
+// Names the existentials made while it lives after statement `i`. Statements checked apart from
+//  each other still end up in one context, their existentials must not share a name.
+struct statement_existentials
+{
+  statement_existentials(std::size_t i)
+    : prefix(std::exchange(exist_prefix, "α" + std::to_string(i) + ".")),
+      counter(std::exchange(exist_counter, 0))
+  {  }
+
+  ~statement_existentials()
+  {
+    exist_prefix = std::move(prefix);
+    exist_counter = counter;
+  }
+
+  std::string prefix;
+  std::size_t counter;
+};
+
+}
+
+typing_fork::typing_fork(const std::vector<CTXElement>& snapshot, ast_ptr of)
+{
+  ctx.arena = &nodes;
+  term_copier copy { nodes, {} };
+
+  for(auto& elem : snapshot)
+  {
+    auto c = copy.element(elem);
+    inherited.insert(c.existential != nullptr ? static_cast<ast_ptr>(c.existential) : c.id_def);
+    ctx.push(c);
+  }
+  stmt = copy(of);
+
+  originals.reserve(copy.copies.size());
+  for(auto& c : copy.copies)
+  {
+    ast_ptr node = c.second;
+    ast_ptr solution = node->kind == ASTNodeKind::exist ? static_cast<exist*>(node)->solution : nullptr;
+    originals.emplace(node, copied { const_cast<ast_ptr>(c.first), node->type, node->annot, solution });
+  }
+}
+
+void typing_fork::merge(typing_context& into) const
+{
+  // copying back maps our copies to their originals, new terms are copied as a whole
+  term_copier copy_back { *into.arena, {} };
+  copy_back.copies.reserve(originals.size());
+  for(auto& c : originals)
+    copy_back.copies.emplace(c.first, c.second.original);
+
+  // Only what changed is written, another fork may have changed the same original before us.
+  for(auto& c : originals)
+  {
+    ast_ptr node = const_cast<ast_ptr>(c.first);
+    ast_ptr original = c.second.original;
+
+    if(node->type != c.second.type)
+      original->type = copy_back(node->type);
+    if(node->annot != c.second.annot)
+      original->annot = copy_back(node->annot);
+    if(node->kind == ASTNodeKind::exist && static_cast<exist*>(node)->solution != c.second.solution)
+      into.solve(static_cast<exist*>(original), copy_back(static_cast<exist*>(node)->solution));
+  }
+
+  // Elements checking inserted in front of one from the snapshot go in front of its original.
+  std::vector<CTXElement> added;
+  for(auto it = ctx.begin(); it != ctx.end(); ++it)
+  {
+    const ast_base* key = it->existential != nullptr ? static_cast<ast_ptr>(it->existential) : it->id_def;
+    if(!inherited.contains(key))
+    {
+      added.emplace_back(copy_back.element(*it));
+      continue;
+    }
+    if(added.empty())
+      continue;
+
+    auto original = copy_back.copies.find(key)->second;
+    auto at = it->existential != nullptr ? into.lookup_ex(original)
+                                         : into.lookup_id(static_cast<identifier*>(original));
+    for(auto& elem : added)
+      at = into.insert(at, elem) + 1;
+    added.clear();
+  }
+  for(auto& elem : added)
+    into.push(elem);
+}
+
+std::vector<std::vector<std::size_t>> hx_ast_type_checking::dependencies(const hx_ast& ast)
+{
+  const auto binders = top_level_binders(ast);
+
+  std::vector<std::vector<std::size_t>> deps(ast.data.size());
+  for(std::size_t i = 0; i < ast.data.size(); ++i)
+  {
+    tsl::robin_set<const ast_base*> seen;
+    collect_dependencies(ast.data[i], binders, seen, deps[i]);
+
+    // a statement never waits for itself or for one that comes after it
+    auto& d = deps[i];
+    d.erase(std::remove_if(d.begin(), d.end(), [i](std::size_t j) { return j >= i; }), d.end());
+    std::sort(d.begin(), d.end());
+    d.erase(std::unique(d.begin(), d.end()), d.end());
+  }
+  return deps;
+}
+
+bool hx_ast_type_checking::check_statements(const hx_ast& ast, thread_pool* pool)
+{
+  const std::size_t count = ast.data.size();
+  const bool parallel = pool != nullptr && pool->thread_count() > 1;
+
+  typing_context ctx;
+  ctx.arena = ast.arena.get();
+  hx_ast_type_checking checker(ast);
+  std::vector<char> checks(count, false);
+
+  auto check_here = [&ast, &ctx, &checker, &checks](std::size_t i)
+  {
+    statement_existentials names(i);
+    checks[i] = checker.find_type(ctx, ast.data[i]) != nullptr;
+  };
+  auto all_check = [&checks]() { return std::all_of(checks.begin(), checks.end(), [](char b) { return b; }); };
+
+  if(!parallel)
+  {
+    for(std::size_t i = 0; i < count; ++i)
+      check_here(i);
+    return all_check();
+  }
+
+  const auto deps = dependencies(ast);
+  const auto binders = top_level_binders(ast);
+
+  // The statements are checked in order in one context. Only a run of statements that don't
+  //  depend on each other is checked in parallel, each in a fork of what it depends on. A
+  //  statement that failed can leave unsolved existentials behind, the statements using it solve
+  //  them one after another, so those are never part of a run.
+  auto may_fork = [&deps, &checks](std::size_t stmt, std::size_t run)
+  {
+    return std::all_of(deps[stmt].begin(), deps[stmt].end(), [&checks, run](std::size_t d)
+      { return d < run && checks[d]; });
+  };
+
+  for(std::size_t i = 0; i < count; )
+  {
+    std::size_t end = i + 1;
+    if(may_fork(i, i))
+      while(end < count && may_fork(end, i))
+        ++end;
+
+    if(end == i + 1)
+    {
+      check_here(i);
+      i = end;
+      continue;
+    }
+
+    std::vector<std::unique_ptr<typing_fork>> forks(end - i);
+    std::vector<std::vector<json::json>> diagnostics(end - i);
+
+    pool->for_each(end - i, [&, i](std::size_t k)
+    {
+      const std::size_t stmt = i + k;
+
+      // leave out what other statements bound that this one can't see, directly or not
+      std::vector<char> visible(stmt, false);
+      std::vector<std::size_t> todo(deps[stmt]);
+      while(!todo.empty())
+      {
+        const std::size_t d = todo.back();
+        todo.pop_back();
+        if(!visible[d])
+        {
+          visible[d] = true;
+          todo.insert(todo.end(), deps[d].begin(), deps[d].end());
+        }
+      }
+
+      std::vector<CTXElement> snapshot;
+      for(auto it = ctx.begin(); it != ctx.end(); ++it)
+      {
+        auto bound = it->id_def != nullptr ? binders.find(it->id_def) : binders.end();
+        if(bound == binders.end() || visible[bound->second])
+          snapshot.push_back(*it);
+      }
+      forks[k] = std::make_unique<typing_fork>(snapshot, ast.data[stmt]);
+
+      auto outer = diagnostics_manager::capture(&diagnostics[k]);
+      statement_existentials names(stmt);
+
+      hx_ast_type_checking fork_checker(ast);
+      checks[stmt] = fork_checker.find_type(forks[k]->ctx, forks[k]->stmt) != nullptr;
+
+      diagnostics_manager::capture(outer);
+    });
+
+    // hand on the results as if the statements were checked one after another
+    for(std::size_t k = 0; k < forks.size(); ++k)
+    {
+      for(auto& msg : diagnostics[k])
+        diagnostic <<= msg;
+      forks[k]->merge(ctx);
+    }
+    i = end;
+  }
+  return all_check();
+}
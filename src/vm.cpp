@@ -3,10 +3,14 @@
 #include <iostream>
 #include <iomanip>
 #include <cassert>
-
-vm::vm(std::size_t initial_heap_size)
-  : regs( { 0 } ), rem(0), pc(0), compare_flag(false),
-    program_blob(), heap(initial_heap_size)
+#include <cstring>
+#include <initializer_list>
+#include <utility>
+
+vm::vm(std::size_t initial_heap_size, vm_dispatch dispatch)
+  : regs( { 0 } ), rem(0), pc(0), compare_flag(false), dispatch_kind(dispatch),
+    program(std::make_shared<const vm_program>()), heap(initial_heap_size), faulted(false),
+    jit(dispatch == vm_dispatch::Jit && H_LANG_VM_HAS_JIT ? std::make_unique<vm_jit>() : nullptr)
 {  }
 
 const std::array<std::int_fast32_t, vm::register_count>& vm::registers() const
@@ -15,210 +19,960 @@ const std::array<std::int_fast32_t, vm::register_count>& vm::registers() const
 std::size_t vm::program_counter() const
 { return pc; }
 
-void vm::set_program(const std::vector<unsigned char>& program)
-{ program_blob = program; }
+vm_heap& vm::memory()
+{ return heap; }
+
+bool vm::heap_fault() const
+{ return faulted; }
+
+vm_dispatch vm::dispatch_mode() const
+{ return dispatch_kind; }
+
+void vm::set_jit_threshold(std::size_t threshold)
+{
+  if(jit)
+    jit->set_threshold(threshold);
+}
+
+std::size_t vm::jit_compiled_blocks() const
+{ return jit ? jit->compiled_blocks() : 0; }
+
+vm_program::vm_program(std::vector<unsigned char> bytes, bool predecode)
+  : bytes(), checks(), decoded(), decoded_index(), storage(std::move(bytes)), owner()
+{
+  this->bytes = storage;
+  checks = verify_program(this->bytes);
+
+  if(predecode)
+    this->predecode();
+}
+
+vm_program::vm_program(bytecode_view code, std::shared_ptr<const void> owner, bool predecode)
+  : bytes(code), checks(verify_program(code)), decoded(), decoded_index(), storage(), owner(std::move(owner))
+{
+  if(predecode)
+    this->predecode();
+}
 
-const std::vector<unsigned char>& vm::get_program() const
-{ return program_blob; }
+void vm::set_program(std::vector<unsigned char> program, bool predecode)
+{ set_program(std::make_shared<const vm_program>(std::move(program), predecode)); }
+
+void vm::set_program(std::shared_ptr<const vm_program> program)
+{
+  this->program = std::move(program);
+
+  if(jit)
+    jit->reset(this->program->bytes.size());
+}
+
+void vm::reset()
+{
+  regs.fill(0);
+  rem = 0;
+  pc = 0;
+  compare_flag = false;
+
+  heap.reset();
+  faulted = false;
+}
+
+void vm::set_registers(const std::array<std::int_fast32_t, register_count>& values)
+{ regs = values; }
+
+bool vm::is_predecoded() const
+{ return !program->decoded.empty(); }
+
+bool vm::is_verified() const
+{ return static_cast<bool>(program->checks); }
+
+const verification& vm::verification_result() const
+{ return program->checks; }
+
+bytecode_view vm::get_program() const
+{ return program->bytes; }
 
 void vm::run()
 {
+  if(jit && is_verified())
+    return run_jit();
+  if(is_predecoded() && run_decoded())
+    return;
+  if(is_verified())
+    return run_unchecked();
+
   // core loop of our vm
-  while(pc < program_blob.size())
-  {
-    run_next_instr();
-  }
+  vm_no_profiling no_profiling;
+  if(dispatch_kind != vm_dispatch::Switch)
+    run_threaded<true>(no_profiling);
+  else
+    run_switch<true>(no_profiling);
+}
+
+void vm::run_unchecked()
+{
+  if(jit && is_verified())
+    return run_jit();
+
+  // the decoded stream only exists for programs whose registers and jumps are in bounds
+  if(is_predecoded() && run_decoded())
+    return;
+  if(pc >= program->bytes.size())
+    return;
+
+  vm_no_profiling no_profiling;
+  if(dispatch_kind != vm_dispatch::Switch)
+    run_threaded<false>(no_profiling);
+  else
+    run_switch<false>(no_profiling);
+}
+
+void vm::run_profiled(vm_profile& profile)
+{
+  if(dispatch_kind != vm_dispatch::Switch)
+    run_threaded<true>(profile);
+  else
+    run_switch<true>(profile);
+
+  profile.finish();
 }
 
 op_code vm::fetch_instr()
-{ return byte_to_opcode(program_blob[pc++]); }
+{ return byte_to_opcode(program->bytes[pc++]); }
 
 unsigned char vm::fetch8()
 {
-  return program_blob[pc++];
+  return program->bytes[pc++];
 }
 
 std::int_fast16_t vm::fetch16()
 {
   // AE F0   is stored as F0 AE
   auto old = pc++;
-  return ((program_blob[old] << 8) | program_blob[pc++]) & 0b1111111111111111;
+  return ((program->bytes[old] << 8) | program->bytes[pc++]) & 0b1111111111111111;
 }
 
-void vm::run_next_instr()
+///// Instruction semantics, shared by all dispatch loops
+
+template<>
+void vm::exec<op_code::LOAD>()
 {
-  if(pc >= program_blob.size())
-    return;
+  const std::size_t reg = fetch8();
+  const std::int_fast16_t num = fetch16();
 
-  auto op = fetch_instr();
-  switch(op)
+  regs[reg] = num;
+}
+
+template<>
+void vm::exec<op_code::ALLOC>()
+{
+  const std::size_t reg = fetch8();
+
+  // the register holds the size and receives the address
+  regs[reg] = regs[reg] < 0 ? 0 : heap.allocate(regs[reg]);
+}
+
+template<>
+void vm::exec<op_code::LOADM>()
+{
+  const std::size_t reg = fetch8();
+  const std::int_fast32_t addr = regs[fetch8()];
+
+  if(const unsigned char* mem = heap.translate(addr, sizeof(std::int32_t)))
   {
-  default:
-    {
-      std::cerr << "Unknown opcode: " << std::hex << static_cast<int>(op) << "\n";
-      return;
-    }
+    std::int32_t value;
+    std::memcpy(&value, mem, sizeof(value));
 
-  case op_code::HALT:
-      return;
+    regs[reg] = value;
+  }
+  else
+    report_heap_fault(addr);
+}
 
-  case op_code::LOAD:
-      {
-        const std::size_t reg = fetch8();
-        const std::int_fast16_t num = fetch16();
+template<>
+void vm::exec<op_code::STOREM>()
+{
+  const std::int_fast32_t addr = regs[fetch8()];
+  const std::int32_t value = regs[fetch8()];
+
+  if(unsigned char* mem = heap.translate(addr, sizeof(std::int32_t)))
+    std::memcpy(mem, &value, sizeof(value));
+  else
+    report_heap_fault(addr);
+}
 
-        regs[reg] = num;
-      } break;
+template<>
+void vm::exec<op_code::ADD>()
+{
+  const std::size_t reg = fetch8();
 
-  case op_code::ALLOC:
-      {
-        const std::size_t reg = fetch8();
-        const unsigned char bytes = regs[reg];
-        const std::size_t size = heap.size() + bytes;
+  const std::int_fast8_t reg0 = fetch8();
+  const std::int_fast8_t reg1 = fetch8();
 
-        heap.resize(size, 0);
-      } break;
+  regs[reg] = reg0 + reg1;
+}
 
-  case op_code::ADD:
-      {
-        const std::size_t reg = fetch8();
+template<>
+void vm::exec<op_code::INC>()
+{
+  const std::size_t reg = fetch8();
 
-        const std::int_fast8_t reg0 = fetch8();
-        const std::int_fast8_t reg1 = fetch8();
+  ++regs[reg];
+}
 
-        regs[reg] = reg0 + reg1;
-      } break;
+template<>
+void vm::exec<op_code::DEC>()
+{
+  const std::size_t reg = fetch8();
 
-  case op_code::INC:
-      {
-        const std::size_t reg = fetch8();
+  --regs[reg];
+}
 
-        ++regs[reg];
-      } break;
+template<>
+void vm::exec<op_code::SHIFT_LEFT>()
+{
+  const std::size_t reg = fetch8();
+  const std::int_fast8_t by = fetch8();
 
-  case op_code::DEC:
-      {
-        const std::size_t reg = fetch8();
+  regs[reg] = reg << by;
+}
 
-        --regs[reg];
-      } break;
+template<>
+void vm::exec<op_code::SHIFT_RIGHT>()
+{
+  const std::size_t reg = fetch8();
+  const std::int_fast8_t by = fetch8();
 
-  case op_code::SHIFT_LEFT:
-      {
-        const std::size_t reg = fetch8();
-        const std::int_fast8_t by = fetch8();
+  regs[reg] = reg >> by;
+}
 
-        regs[reg] = reg << by;
-      } break;
+template<>
+void vm::exec<op_code::SUB>()
+{
+  const std::size_t reg = fetch8();
 
-  case op_code::SHIFT_RIGHT:
-      {
-        const std::size_t reg = fetch8();
-        const std::int_fast8_t by = fetch8();
+  const std::int_fast8_t reg0 = fetch8();
+  const std::int_fast8_t reg1 = fetch8();
 
-        regs[reg] = reg >> by;
-      } break;
+  regs[reg] = reg0 - reg1;
+}
 
-  case op_code::SUB:
-      {
-        const std::size_t reg = fetch8();
+template<>
+void vm::exec<op_code::MUL>()
+{
+  const std::size_t reg = fetch8();
 
-        const std::int_fast8_t reg0 = fetch8();
-        const std::int_fast8_t reg1 = fetch8();
+  const std::int_fast8_t reg0 = fetch8();
+  const std::int_fast8_t reg1 = fetch8();
 
-        regs[reg] = reg0 - reg1;
-      } break;
+  regs[reg] = reg0 * reg1;
+}
 
-  case op_code::MUL:
-      {
-        const std::size_t reg = fetch8();
+template<>
+void vm::exec<op_code::DIV>()
+{
+  const std::size_t reg = fetch8();
 
-        const std::int_fast8_t reg0 = fetch8();
-        const std::int_fast8_t reg1 = fetch8();
+  const std::int_fast8_t reg0 = regs[fetch8()];
+  const std::int_fast8_t reg1 = regs[fetch8()];
 
-        regs[reg] = reg0 * reg1;
-      } break;
+  regs[reg] = reg0 / reg1;
+  rem = reg0 % reg1;
+}
 
-  case op_code::DIV:
-      {
-        const std::size_t reg = fetch8();
+template<>
+void vm::exec<op_code::JMP>()
+{
+  const std::size_t reg = fetch8();
+
+  pc = regs[reg];
+}
+
+template<>
+void vm::exec<op_code::JMPREL>()
+{
+  const int rel_pos = fetch8();
 
-        const std::int_fast8_t reg0 = regs[fetch8()];
-        const std::int_fast8_t reg1 = regs[fetch8()];
+  pc = pc + rel_pos;
+}
+
+template<>
+void vm::exec<op_code::JMP_CMP>()
+{
+  const std::int_fast8_t reg = fetch8();
+
+  if(compare_flag)
+    pc = pc + reg;
+}
+
+template<>
+void vm::exec<op_code::JMP_NCMP>()
+{
+  const std::int_fast8_t reg = fetch8();
+
+  if(!compare_flag)
+    pc = pc + reg;
+}
+
+template<>
+void vm::exec<op_code::EQUAL>()
+{
+  const std::int_fast8_t reg0 = regs[fetch8()];
+  const std::int_fast8_t reg1 = regs[fetch8()];
+
+  compare_flag = (reg0 == reg1);
+}
+
+template<>
+void vm::exec<op_code::GREATER>()
+{
+  const std::int_fast8_t reg0 = regs[fetch8()];
+  const std::int_fast8_t reg1 = regs[fetch8()];
 
-        regs[reg] = reg0 / reg1;
-        rem = reg0 % reg1;
-      } break;
+  compare_flag = (reg0 > reg1);
+}
+
+template<>
+void vm::exec<op_code::LESS>()
+{
+  const std::int_fast8_t reg0 = regs[fetch8()];
+  const std::int_fast8_t reg1 = regs[fetch8()];
+
+  compare_flag = (reg0 < reg1);
+}
+
+template<>
+void vm::exec<op_code::GREATER_EQUAL>()
+{
+  const std::int_fast8_t reg0 = regs[fetch8()];
+  const std::int_fast8_t reg1 = regs[fetch8()];
+
+  compare_flag = (reg0 >= reg1);
+}
+
+template<>
+void vm::exec<op_code::LESS_EQUAL>()
+{
+  const std::int_fast8_t reg0 = regs[fetch8()];
+  const std::int_fast8_t reg1 = regs[fetch8()];
+
+  compare_flag = (reg0 <= reg1);
+}
+
+// superinstructions run their sequence back to back, skipping the inner opcodes. Only the verifier
+//  guarantees that the sequence is there, unverified programs just run the first instruction and
+//  dispatch the rest one by one, like the decoded stream does.
+
+template<>
+void vm::exec<op_code::LOAD_LOAD_ADD>()
+{
+  exec<op_code::LOAD>();
+  if(!is_verified())
+    return;
+  ++pc;
+  exec<op_code::LOAD>();
+  ++pc;
+  exec<op_code::ADD>();
+}
+
+template<>
+void vm::exec<op_code::EQUAL_JMP_CMP>()
+{
+  exec<op_code::EQUAL>();
+  if(!is_verified())
+    return;
+  ++pc;
+  exec<op_code::JMP_CMP>();
+}
+
+template<>
+void vm::exec<op_code::INC_LESS_JMP_CMP>()
+{
+  exec<op_code::INC>();
+  if(!is_verified())
+    return;
+  ++pc;
+  exec<op_code::LESS>();
+  ++pc;
+  exec<op_code::JMP_CMP>();
+}
+
+template<>
+void vm::exec<op_code::UNKNOWN>()
+{
+  std::cerr << "Unknown opcode: " << std::hex << static_cast<int>(program->bytes[pc - 1]) << "\n";
+}
+
+///// Switch dispatch
+
+bool vm::run_next_instr()
+{
+  if(pc >= program->bytes.size() || !valid_operands())
+    return false;
+
+  return dispatch(fetch_instr());
+}
+
+bool vm::dispatch(op_code op)
+{
+  switch(op)
+  {
+  default:                      exec<op_code::UNKNOWN>();       break;
+
+  case op_code::HALT:           return false;
+
+  case op_code::LOAD:           exec<op_code::LOAD>();          break;
+  case op_code::ALLOC:          exec<op_code::ALLOC>();         break;
+  case op_code::ADD:            exec<op_code::ADD>();           break;
+  case op_code::INC:            exec<op_code::INC>();           break;
+  case op_code::DEC:            exec<op_code::DEC>();           break;
+  case op_code::SHIFT_LEFT:     exec<op_code::SHIFT_LEFT>();    break;
+  case op_code::SHIFT_RIGHT:    exec<op_code::SHIFT_RIGHT>();   break;
+  case op_code::SUB:            exec<op_code::SUB>();           break;
+  case op_code::MUL:            exec<op_code::MUL>();           break;
+  case op_code::DIV:            exec<op_code::DIV>();           break;
+  case op_code::JMPREL:         exec<op_code::JMPREL>();        break;
+  case op_code::JMP_CMP:        exec<op_code::JMP_CMP>();       break;
+  case op_code::JMP_NCMP:       exec<op_code::JMP_NCMP>();      break;
+  case op_code::EQUAL:          exec<op_code::EQUAL>();         break;
+  case op_code::GREATER:        exec<op_code::GREATER>();       break;
+  case op_code::LESS:           exec<op_code::LESS>();          break;
+  case op_code::GREATER_EQUAL:  exec<op_code::GREATER_EQUAL>(); break;
+  case op_code::LESS_EQUAL:     exec<op_code::LESS_EQUAL>();    break;
+
+  case op_code::LOAD_LOAD_ADD:    exec<op_code::LOAD_LOAD_ADD>();    break;
+  case op_code::EQUAL_JMP_CMP:    exec<op_code::EQUAL_JMP_CMP>();    break;
+  case op_code::INC_LESS_JMP_CMP: exec<op_code::INC_LESS_JMP_CMP>(); break;
 
   case op_code::JMP:
       {
-        const std::size_t reg = fetch8();
+        // register jumps can't be verified ahead of time, so they are always checked
+        exec<op_code::JMP>();
 
-        pc = regs[reg];
-      } break;
+        return valid_jump_target();
+      }
 
-  case op_code::JMPREL:
-      {
-        const int rel_pos = fetch8();
+  // same for addresses
+  case op_code::LOADM:          exec<op_code::LOADM>();         return !faulted;
+  case op_code::STOREM:         exec<op_code::STOREM>();        return !faulted;
+  }
+  return true;
+}
 
-        pc = pc + rel_pos;
-      } break;
+bool vm::valid_operands() const
+{
+  const op_code op = byte_to_opcode(program->bytes[pc]);
+  if(pc + instruction_length(op) > program->bytes.size())
+    return false;
 
-  case op_code::JMP_CMP:
-      {
-        const std::int_fast8_t reg = fetch8();
+  // only the verifier rules out registers that don't exist, the handlers index them as they are
+  for(std::size_t i = 1; i <= register_operands(op); ++i)
+  {
+    if(program->bytes[pc + i] >= register_count)
+    {
+      std::cerr << "Invalid register: " << std::dec << static_cast<int>(program->bytes[pc + i]) << "\n";
+      return false;
+    }
+  }
+  return true;
+}
 
-        if(compare_flag)
-          pc = pc + reg;
-      } break;
+bool vm::valid_jump_target() const
+{
+  if(pc >= program->bytes.size())
+    return false;
 
-  case op_code::JMP_NCMP:
-      {
-        const std::int_fast8_t reg = fetch8();
+  if(is_verified() && !program->checks.instruction_starts[pc])
+  {
+    // keep verified programs on instruction boundaries, otherwise unchecked execution would be unsafe
+    std::cerr << "Invalid jump target: " << std::dec << pc << "\n";
+    return false;
+  }
+  return true;
+}
 
-        if(!compare_flag)
-          pc = pc + reg;
-      } break;
+void vm::report_heap_fault(std::int_fast32_t addr)
+{
+  std::cerr << "Invalid heap access: " << std::dec << addr << "\n";
+  faulted = true;
+}
 
-  case op_code::EQUAL:
-      {
-        const std::int_fast8_t reg0 = regs[fetch8()];
-        const std::int_fast8_t reg1 = regs[fetch8()];
+template<bool checked, typename profiler>
+void vm::run_switch(profiler& prof)
+{
+  for(;;)
+  {
+    if constexpr(checked)
+      if(pc >= program->bytes.size() || !valid_operands())
+        return;
 
-        compare_flag = (reg0 == reg1);
-      } break;
+    prof.step(pc, byte_to_opcode(program->bytes[pc]));
+    if(!dispatch(fetch_instr()))
+      return;
+  }
+}
 
-  case op_code::GREATER:
-      {
-        const std::int_fast8_t reg0 = regs[fetch8()];
-        const std::int_fast8_t reg1 = regs[fetch8()];
+///// Threaded dispatch
 
-        compare_flag = (reg0 > reg1);
-      } break;
+#if H_LANG_VM_HAS_THREADED_DISPATCH
+// Every byte not listed jumps to `unknown`.
+static std::array<void*, 256> threaded_labels(void* unknown, std::initializer_list<std::pair<op_code, void*>> ops)
+{
+  std::array<void*, 256> labels;
+  labels.fill(unknown);
+  for(auto [op, label] : ops)
+    labels[opcode_to_byte(op)] = label;
+  return labels;
+}
 
-  case op_code::LESS:
-      {
-        const std::int_fast8_t reg0 = regs[fetch8()];
-        const std::int_fast8_t reg1 = regs[fetch8()];
+#pragma GCC diagnostic push
+#pragma GCC diagnostic ignored "-Wpedantic"
+#endif
+
+template<bool checked, typename profiler>
+void vm::run_threaded(profiler& prof)
+{
+#if H_LANG_VM_HAS_THREADED_DISPATCH
+  // built once per instantiation, the label addresses don't change between runs
+  static const std::array<void*, 256> labels = threaded_labels(&&op_unknown, {
+    { op_code::HALT,          &&op_halt },
+    { op_code::LOAD,          &&op_load },
+    { op_code::ALLOC,         &&op_alloc },
+    { op_code::ADD,           &&op_add },
+    { op_code::INC,           &&op_inc },
+    { op_code::DEC,           &&op_dec },
+    { op_code::SHIFT_LEFT,    &&op_shift_left },
+    { op_code::SHIFT_RIGHT,   &&op_shift_right },
+    { op_code::SUB,           &&op_sub },
+    { op_code::MUL,           &&op_mul },
+    { op_code::DIV,           &&op_div },
+    { op_code::JMP,           &&op_jmp },
+    { op_code::JMPREL,        &&op_jmprel },
+    { op_code::JMP_CMP,       &&op_jmp_cmp },
+    { op_code::JMP_NCMP,      &&op_jmp_ncmp },
+    { op_code::EQUAL,         &&op_equal },
+    { op_code::GREATER,       &&op_greater },
+    { op_code::LESS,          &&op_less },
+    { op_code::GREATER_EQUAL, &&op_greater_equal },
+    { op_code::LESS_EQUAL,    &&op_less_equal },
+
+    { op_code::LOAD_LOAD_ADD,    &&op_load_load_add },
+    { op_code::EQUAL_JMP_CMP,    &&op_equal_jmp_cmp },
+    { op_code::INC_LESS_JMP_CMP, &&op_inc_less_jmp_cmp },
+
+    { op_code::LOADM,         &&op_loadm },
+    { op_code::STOREM,        &&op_storem },
+  });
+
+#define H_LANG_VM_NEXT()                                     \
+  do {                                                       \
+    if constexpr(checked)                                    \
+      if(pc >= program->bytes.size() || !valid_operands())   \
+        return;                                              \
+    prof.step(pc, byte_to_opcode(program->bytes[pc]));       \
+    goto *labels[program->bytes[pc++]];                      \
+  } while(0)
+
+  H_LANG_VM_NEXT();
+
+op_halt:          return;
+op_unknown:       exec<op_code::UNKNOWN>();       H_LANG_VM_NEXT();
+op_load:          exec<op_code::LOAD>();          H_LANG_VM_NEXT();
+op_alloc:         exec<op_code::ALLOC>();         H_LANG_VM_NEXT();
+op_add:           exec<op_code::ADD>();           H_LANG_VM_NEXT();
+op_inc:           exec<op_code::INC>();           H_LANG_VM_NEXT();
+op_dec:           exec<op_code::DEC>();           H_LANG_VM_NEXT();
+op_shift_left:    exec<op_code::SHIFT_LEFT>();    H_LANG_VM_NEXT();
+op_shift_right:   exec<op_code::SHIFT_RIGHT>();   H_LANG_VM_NEXT();
+op_sub:           exec<op_code::SUB>();           H_LANG_VM_NEXT();
+op_mul:           exec<op_code::MUL>();           H_LANG_VM_NEXT();
+op_div:           exec<op_code::DIV>();           H_LANG_VM_NEXT();
+op_jmprel:        exec<op_code::JMPREL>();        H_LANG_VM_NEXT();
+op_jmp_cmp:       exec<op_code::JMP_CMP>();       H_LANG_VM_NEXT();
+op_jmp_ncmp:      exec<op_code::JMP_NCMP>();      H_LANG_VM_NEXT();
+op_equal:         exec<op_code::EQUAL>();         H_LANG_VM_NEXT();
+op_greater:       exec<op_code::GREATER>();       H_LANG_VM_NEXT();
+op_less:          exec<op_code::LESS>();          H_LANG_VM_NEXT();
+op_greater_equal: exec<op_code::GREATER_EQUAL>(); H_LANG_VM_NEXT();
+op_less_equal:    exec<op_code::LESS_EQUAL>();    H_LANG_VM_NEXT();
+
+op_load_load_add:    exec<op_code::LOAD_LOAD_ADD>();    H_LANG_VM_NEXT();
+op_equal_jmp_cmp:    exec<op_code::EQUAL_JMP_CMP>();    H_LANG_VM_NEXT();
+op_inc_less_jmp_cmp: exec<op_code::INC_LESS_JMP_CMP>(); H_LANG_VM_NEXT();
+op_jmp:
+  exec<op_code::JMP>();
+  if(!valid_jump_target())
+    return;
+  H_LANG_VM_NEXT();
+op_loadm:
+  exec<op_code::LOADM>();
+  if(faulted)
+    return;
+  H_LANG_VM_NEXT();
+op_storem:
+  exec<op_code::STOREM>();
+  if(faulted)
+    return;
+  H_LANG_VM_NEXT();
+
+#undef H_LANG_VM_NEXT
+#else
+  run_switch<checked>(prof);
+#endif
+}
+
+#if H_LANG_VM_HAS_THREADED_DISPATCH
+#pragma GCC diagnostic pop
+#endif
+
+
+///// Pre-decoded instruction stream
+
+static constexpr std::uint32_t no_instruction = static_cast<std::uint32_t>(-1);
+
+bool vm_program::predecode()
+{
+  const std::size_t size = bytes.size();
+  if(size >= no_instruction)
+    return false;
 
-        compare_flag = (reg0 < reg1);
-      } break;
+  decoded_index.assign(size + 1, no_instruction);
 
-  case op_code::GREATER_EQUAL:
+  // first pass: split the blob into instructions
+  for(std::size_t offset = 0; offset < size; )
+  {
+    const op_code op = byte_to_opcode(bytes[offset]);
+    const bool known = opcode_to_byte(op) < opcode_to_byte(op_code::UNKNOWN);
+    const std::size_t len = instruction_length(known ? op : op_code::UNKNOWN);
+
+    if(offset + len > size)
+    {
+      // last instruction is missing its operands
+      decoded.clear();
+      decoded_index.clear();
+      return false;
+    }
+    // the decoded handlers index the registers without checking, the program may not be verified
+    for(std::size_t i = 1; i <= register_operands(known ? op : op_code::UNKNOWN); ++i)
+    {
+      if(bytes[offset + i] >= vm::register_count)
       {
-        const std::int_fast8_t reg0 = regs[fetch8()];
-        const std::int_fast8_t reg1 = regs[fetch8()];
+        decoded.clear();
+        decoded_index.clear();
+        return false;
+      }
+    }
+
+    decoded_instruction ins { known ? op : op_code::UNKNOWN, 0, 0, 0, 0, 0, static_cast<std::uint32_t>(offset) };
+    switch(ins.op)
+    {
+    case op_code::HALT:
+      ins.dst = 1;
+      break;
+
+    case op_code::UNKNOWN:
+      ins.dst = bytes[offset];
+      break;
+
+    case op_code::LOAD:
+    case op_code::LOAD_LOAD_ADD:
+      ins.dst = bytes[offset + 1];
+      ins.imm = ((bytes[offset + 2] << 8) | bytes[offset + 3]) & 0b1111111111111111;
+      break;
+
+    default:
+      ins.dst  = len > 1 ? bytes[offset + 1] : 0;
+      ins.src0 = len > 2 ? bytes[offset + 2] : 0;
+      ins.src1 = len > 3 ? bytes[offset + 3] : 0;
+      break;
+    }
+    decoded_index[offset] = decoded.size();
+    decoded.push_back(ins);
+
+    offset += len;
+  }
+  // end sentinel, a HALT that is zero bytes long
+  decoded_index[size] = decoded.size();
+  decoded.push_back({ op_code::HALT, 0, 0, 0, 0, 0, static_cast<std::uint32_t>(size) });
 
-        compare_flag = (reg0 >= reg1);
-      } break;
+  // superinstruction handlers read the decoded sequence after them, so make sure it's there
+  for(std::size_t i = 0; i < decoded.size(); ++i)
+  {
+    const auto* fused = find_superinstruction(decoded[i].op);
+    if(fused == nullptr)
+      continue;
 
-  case op_code::LESS_EQUAL:
+    for(std::size_t j = 1; j < fused->count; ++j)
+    {
+      if(i + j >= decoded.size() || decoded[i + j].op != fused->sequence[j])
       {
-        const std::int_fast8_t reg0 = regs[fetch8()];
-        const std::int_fast8_t reg1 = regs[fetch8()];
+        decoded[i].op = fused->sequence.front();
+        break;
+      }
+    }
+  }
 
-        compare_flag = (reg0 <= reg1);
-      } break;
+  // second pass: resolve jump targets
+  for(auto& ins : decoded)
+  {
+    std::size_t target = 0;
+    switch(ins.op)
+    {
+    default:
+      continue;
+
+    case op_code::JMPREL:
+      target = ins.offset + instruction_length(ins.op) + ins.dst;
+      break;
+
+    case op_code::JMP_CMP:
+    case op_code::JMP_NCMP:
+      target = ins.offset + instruction_length(ins.op) + static_cast<std::int_fast8_t>(ins.dst);
+      break;
+    }
+    if(target > size || decoded_index[target] == no_instruction)
+    {
+      decoded.clear();
+      decoded_index.clear();
+      return false;
+    }
+    ins.target = decoded_index[target];
   }
+  return true;
 }
 
+#if H_LANG_VM_HAS_THREADED_DISPATCH
+#pragma GCC diagnostic push
+#pragma GCC diagnostic ignored "-Wpedantic"
+#endif
+
+// Returns false if execution has to continue from the program blob at `pc`.
+bool vm::run_decoded()
+{
+  if(pc >= program->bytes.size())
+    return true;
+  if(program->decoded_index[pc] == no_instruction)
+    return false;
+
+  const decoded_instruction* const base = program->decoded.data();
+  const decoded_instruction* ip = base + program->decoded_index[pc];
+
+#if H_LANG_VM_HAS_THREADED_DISPATCH
+  static void* const labels[] = {
+    &&op_HALT, &&op_LOAD, &&op_ADD, &&op_SUB, &&op_MUL, &&op_DIV, &&op_JMP, &&op_JMPREL,
+    &&op_JMP_CMP, &&op_JMP_NCMP, &&op_EQUAL, &&op_GREATER, &&op_LESS, &&op_GREATER_EQUAL,
+    &&op_LESS_EQUAL, &&op_ALLOC, &&op_INC, &&op_DEC, &&op_SHIFT_LEFT, &&op_SHIFT_RIGHT,
+    &&op_LOAD_LOAD_ADD, &&op_EQUAL_JMP_CMP, &&op_INC_LESS_JMP_CMP, &&op_LOADM, &&op_STOREM, &&op_UNKNOWN
+  };
+  static_assert(sizeof(labels) / sizeof(labels[0]) == opcode_to_byte(op_code::UNKNOWN) + 1,
+                "Every opcode needs a label.");
+
+#define H_LANG_VM_CASE(name) op_##name
+#define H_LANG_VM_NEXT() goto *labels[opcode_to_byte(ip->op)]
+
+  H_LANG_VM_NEXT();
+  {
+#else
+#define H_LANG_VM_CASE(name) case op_code::name
+#define H_LANG_VM_NEXT() continue
+
+  for(;;)
+  switch(ip->op)
+  {
+#endif
+  H_LANG_VM_CASE(HALT):
+    // the end sentinel has a length of zero
+    pc = ip->offset + ip->dst;
+    return true;
+
+  H_LANG_VM_CASE(UNKNOWN):
+    std::cerr << "Unknown opcode: " << std::hex << static_cast<int>(ip->dst) << "\n";
+    ++ip;
+    H_LANG_VM_NEXT();
+
+  H_LANG_VM_CASE(LOAD):
+    regs[ip->dst] = ip->imm;
+    ++ip;
+    H_LANG_VM_NEXT();
+
+  H_LANG_VM_CASE(ALLOC):
+    regs[ip->dst] = regs[ip->dst] < 0 ? 0 : heap.allocate(regs[ip->dst]);
+    ++ip;
+    H_LANG_VM_NEXT();
+
+  H_LANG_VM_CASE(LOADM):
+    if(const unsigned char* mem = heap.translate(regs[ip->src0], sizeof(std::int32_t)))
+    {
+      std::int32_t value;
+      std::memcpy(&value, mem, sizeof(value));
+
+      regs[ip->dst] = value;
+    }
+    else
+    {
+      pc = ip->offset + instruction_length(op_code::LOADM);
+      report_heap_fault(regs[ip->src0]);
+      return true;
+    }
+    ++ip;
+    H_LANG_VM_NEXT();
+
+  H_LANG_VM_CASE(STOREM):
+    if(unsigned char* mem = heap.translate(regs[ip->dst], sizeof(std::int32_t)))
+    {
+      const std::int32_t value = regs[ip->src0];
+      std::memcpy(mem, &value, sizeof(value));
+    }
+    else
+    {
+      pc = ip->offset + instruction_length(op_code::STOREM);
+      report_heap_fault(regs[ip->dst]);
+      return true;
+    }
+    ++ip;
+    H_LANG_VM_NEXT();
+
+  H_LANG_VM_CASE(ADD):
+    regs[ip->dst] = static_cast<std::int_fast8_t>(ip->src0) + static_cast<std::int_fast8_t>(ip->src1);
+    ++ip;
+    H_LANG_VM_NEXT();
+
+  H_LANG_VM_CASE(SUB):
+    regs[ip->dst] = static_cast<std::int_fast8_t>(ip->src0) - static_cast<std::int_fast8_t>(ip->src1);
+    ++ip;
+    H_LANG_VM_NEXT();
+
+  H_LANG_VM_CASE(MUL):
+    regs[ip->dst] = static_cast<std::int_fast8_t>(ip->src0) * static_cast<std::int_fast8_t>(ip->src1);
+    ++ip;
+    H_LANG_VM_NEXT();
+
+  H_LANG_VM_CASE(DIV):
+    {
+      const std::int_fast8_t reg0 = regs[ip->src0];
+      const std::int_fast8_t reg1 = regs[ip->src1];
+
+      regs[ip->dst] = reg0 / reg1;
+      rem = reg0 % reg1;
+    }
+    ++ip;
+    H_LANG_VM_NEXT();
+
+  H_LANG_VM_CASE(INC):
+    ++regs[ip->dst];
+    ++ip;
+    H_LANG_VM_NEXT();
+
+  H_LANG_VM_CASE(DEC):
+    --regs[ip->dst];
+    ++ip;
+    H_LANG_VM_NEXT();
+
+  H_LANG_VM_CASE(SHIFT_LEFT):
+    regs[ip->dst] = static_cast<std::size_t>(ip->dst) << static_cast<std::int_fast8_t>(ip->src0);
+    ++ip;
+    H_LANG_VM_NEXT();
+
+  H_LANG_VM_CASE(SHIFT_RIGHT):
+    regs[ip->dst] = static_cast<std::size_t>(ip->dst) >> static_cast<std::int_fast8_t>(ip->src0);
+    ++ip;
+    H_LANG_VM_NEXT();
+
+  H_LANG_VM_CASE(JMP):
+    {
+      // register jumps are only known at runtime
+      pc = regs[ip->dst];
+      if(pc >= program->bytes.size())
+        return true;
+      if(program->decoded_index[pc] == no_instruction)
+        return !valid_jump_target();
+      ip = base + program->decoded_index[pc];
+    }
+    H_LANG_VM_NEXT();
+
+  H_LANG_VM_CASE(JMPREL):
+    ip = base + ip->target;
+    H_LANG_VM_NEXT();
+
+  H_LANG_VM_CASE(JMP_CMP):
+    ip = compare_flag ? base + ip->target : ip + 1;
+    H_LANG_VM_NEXT();
+
+  H_LANG_VM_CASE(JMP_NCMP):
+    ip = !compare_flag ? base + ip->target : ip + 1;
+    H_LANG_VM_NEXT();
+
+  H_LANG_VM_CASE(EQUAL):
+    compare_flag = static_cast<std::int_fast8_t>(regs[ip->dst]) == static_cast<std::int_fast8_t>(regs[ip->src0]);
+    ++ip;
+    H_LANG_VM_NEXT();
+
+  H_LANG_VM_CASE(GREATER):
+    compare_flag = static_cast<std::int_fast8_t>(regs[ip->dst]) > static_cast<std::int_fast8_t>(regs[ip->src0]);
+    ++ip;
+    H_LANG_VM_NEXT();
+
+  H_LANG_VM_CASE(LESS):
+    compare_flag = static_cast<std::int_fast8_t>(regs[ip->dst]) < static_cast<std::int_fast8_t>(regs[ip->src0]);
+    ++ip;
+    H_LANG_VM_NEXT();
+
+  H_LANG_VM_CASE(GREATER_EQUAL):
+    compare_flag = static_cast<std::int_fast8_t>(regs[ip->dst]) >= static_cast<std::int_fast8_t>(regs[ip->src0]);
+    ++ip;
+    H_LANG_VM_NEXT();
+
+  H_LANG_VM_CASE(LESS_EQUAL):
+    compare_flag = static_cast<std::int_fast8_t>(regs[ip->dst]) <= static_cast<std::int_fast8_t>(regs[ip->src0]);
+    ++ip;
+    H_LANG_VM_NEXT();
+
+  H_LANG_VM_CASE(LOAD_LOAD_ADD):
+    regs[ip[0].dst] = ip[0].imm;
+    regs[ip[1].dst] = ip[1].imm;
+    regs[ip[2].dst] = static_cast<std::int_fast8_t>(ip[2].src0) + static_cast<std::int_fast8_t>(ip[2].src1);
+    ip += 3;
+    H_LANG_VM_NEXT();
+
+  H_LANG_VM_CASE(EQUAL_JMP_CMP):
+    compare_flag = static_cast<std::int_fast8_t>(regs[ip->dst]) == static_cast<std::int_fast8_t>(regs[ip->src0]);
+    ip = compare_flag ? base + ip[1].target : ip + 2;
+    H_LANG_VM_NEXT();
+
+  H_LANG_VM_CASE(INC_LESS_JMP_CMP):
+    ++regs[ip[0].dst];
+    compare_flag = static_cast<std::int_fast8_t>(regs[ip[1].dst]) < static_cast<std::int_fast8_t>(regs[ip[1].src0]);
+    ip = compare_flag ? base + ip[2].target : ip + 3;
+    H_LANG_VM_NEXT();
+  }
+
+#undef H_LANG_VM_CASE
+#undef H_LANG_VM_NEXT
+}
+
+#if H_LANG_VM_HAS_THREADED_DISPATCH
+#pragma GCC diagnostic pop
+#endif
+
+///// JIT tier
+
+void vm::run_jit()
+{
+  // block entries are the start and wherever the interpreter had to take over from a block
+  bool at_block_entry = true;
+  while(pc < program->bytes.size())
+  {
+    if(at_block_entry)
+    {
+      if(auto block = jit->enter(program->bytes, pc))
+      {
+        pc = block(regs.data(), &compare_flag);
+        continue;
+      }
+    }
+    const op_code op = byte_to_opcode(program->bytes[pc]);
+    if(!run_next_instr())
+      return;
+
+    at_block_entry = vm_jit::ends_block(op);
+  }
+}
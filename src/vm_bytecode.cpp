@@ -0,0 +1,272 @@
+#include <vm_bytecode.hpp>
+#include <program.hpp>
+
+#include <fstream>
+#include <iterator>
+#include <array>
+
+#if defined(__unix__) || defined(__APPLE__)
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <fcntl.h>
+#include <unistd.h>
+#define H_LANG_HAS_MMAP 1
+#else
+#define H_LANG_HAS_MMAP 0
+#endif
+
+std::string_view bytecode_error_to_str(bytecode_error err)
+{
+  switch(err)
+  {
+  default:
+  case bytecode_error::None: return "None";
+  case bytecode_error::CannotOpen: return "File can not be opened";
+  case bytecode_error::Truncated: return "File is too small for its header";
+  case bytecode_error::BadMagic: return "File is not hx bytecode";
+  case bytecode_error::UnsupportedVersion: return "Bytecode version is not supported";
+  case bytecode_error::BadSection: return "Section lies outside of the file or is malformed";
+  case bytecode_error::ChecksumMismatch: return "Checksum does not match, the file is corrupted";
+  }
+}
+
+namespace
+{
+
+constexpr std::array<unsigned char, 4> magic = { 'H', 'X', 'B', 'C' };
+
+constexpr std::size_t header_size = 64;
+constexpr std::size_t symbol_size = 16;
+
+// byte offsets of the header fields
+enum header_field : std::size_t
+{
+  version_field        = 4,
+  flags_field          = 6,
+  code_offset_field    = 8,
+  code_size_field      = 12,
+  symbols_offset_field = 16,
+  symbol_count_field   = 20,
+  strings_offset_field = 24,
+  strings_size_field   = 28,
+  checksum_field       = 32,
+};
+
+constexpr std::array<std::uint32_t, 256> make_crc_table()
+{
+  std::array<std::uint32_t, 256> table {};
+  for(std::uint32_t i = 0; i < 256; ++i)
+  {
+    std::uint32_t c = i;
+    for(int k = 0; k < 8; ++k)
+      c = (c & 1) ? 0xEDB88320U ^ (c >> 1) : c >> 1;
+    table[i] = c;
+  }
+  return table;
+}
+constexpr auto crc_table = make_crc_table();
+
+// CRC-32 as used by zlib
+std::uint32_t crc32(const unsigned char* data, std::size_t size)
+{
+  std::uint32_t c = 0xFFFFFFFFU;
+  for(std::size_t i = 0; i < size; ++i)
+    c = crc_table[(c ^ data[i]) & 0xFF] ^ (c >> 8);
+  return c ^ 0xFFFFFFFFU;
+}
+
+void put16(unsigned char* at, std::uint16_t v)
+{ at[0] = v & 0xFF; at[1] = v >> 8; }
+
+void put32(unsigned char* at, std::uint32_t v)
+{ for(int i = 0; i < 4; ++i) at[i] = (v >> (8 * i)) & 0xFF; }
+
+std::uint16_t get16(const unsigned char* at)
+{ return at[0] | (at[1] << 8); }
+
+std::uint32_t get32(const unsigned char* at)
+{ return at[0] | (at[1] << 8) | (at[2] << 16) | (static_cast<std::uint32_t>(at[3]) << 24); }
+
+}
+
+std::vector<unsigned char> emit_bytecode(bytecode_view code, const std::vector<ass::symbol_entry>& symbols)
+{
+  std::size_t strings_size = 0;
+  for(const auto& s : symbols)
+    strings_size += s.name.size();
+
+  const std::size_t code_offset = header_size;
+  const std::size_t symbols_offset = code_offset + code.size();
+  const std::size_t strings_offset = symbols_offset + symbols.size() * symbol_size;
+
+  std::vector<unsigned char> file(strings_offset + strings_size, 0);
+  unsigned char* const out = file.data();
+
+  std::copy(magic.begin(), magic.end(), out);
+  put16(out + version_field, bytecode_version);
+  put16(out + flags_field, 0);
+  put32(out + code_offset_field, code_offset);
+  put32(out + code_size_field, code.size());
+  put32(out + symbols_offset_field, symbols_offset);
+  put32(out + symbol_count_field, symbols.size());
+  put32(out + strings_offset_field, strings_offset);
+  put32(out + strings_size_field, strings_size);
+
+  std::copy(code.begin(), code.end(), out + code_offset);
+
+  std::size_t name_offset = 0;
+  for(std::size_t i = 0; i < symbols.size(); ++i)
+  {
+    const auto& s = symbols[i];
+    unsigned char* const entry = out + symbols_offset + i * symbol_size;
+
+    put32(entry + 0, name_offset);
+    put32(entry + 4, s.name.size());
+    put32(entry + 8, s.offset);
+    entry[12] = static_cast<unsigned char>(s.type);
+
+    std::copy(s.name.begin(), s.name.end(), out + strings_offset + name_offset);
+    name_offset += s.name.size();
+  }
+
+  put32(out + checksum_field, crc32(out + header_size, file.size() - header_size));
+  return file;
+}
+
+std::vector<unsigned char> emit_bytecode(const ass::program& prog)
+{ return emit_bytecode(prog.get_bytes(), prog.symbols()); }
+
+bool write_bytecode(const std::vector<unsigned char>& file, const std::string& path)
+{
+  std::ofstream out(path, std::ios::out | std::ios::binary | std::ios::trunc);
+  out.write(reinterpret_cast<const char*>(file.data()), file.size());
+
+  return static_cast<bool>(out);
+}
+
+
+bytecode_file::bytecode_file()
+  : mapping(nullptr), mapping_size(0), fallback(), code_section(), syms()
+{  }
+
+bytecode_file::~bytecode_file()
+{
+#if H_LANG_HAS_MMAP
+  if(mapping != nullptr)
+    munmap(const_cast<unsigned char*>(mapping), mapping_size);
+#endif
+}
+
+std::shared_ptr<const bytecode_file> bytecode_file::open(const std::string& path, bytecode_error& error,
+                                                         bool check_checksum)
+{
+  std::shared_ptr<bytecode_file> file(new bytecode_file());
+
+#if H_LANG_HAS_MMAP
+  const int fd = ::open(path.c_str(), O_RDONLY);
+  if(fd < 0)
+  {
+    error = bytecode_error::CannotOpen;
+    return nullptr;
+  }
+
+  struct stat info;
+  if(fstat(fd, &info) != 0)
+  {
+    ::close(fd);
+    error = bytecode_error::CannotOpen;
+    return nullptr;
+  }
+  if(static_cast<std::size_t>(info.st_size) < header_size)
+  {
+    ::close(fd);
+    error = bytecode_error::Truncated;
+    return nullptr;
+  }
+
+  void* mem = mmap(nullptr, info.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+  ::close(fd);
+
+  if(mem == MAP_FAILED)
+  {
+    error = bytecode_error::CannotOpen;
+    return nullptr;
+  }
+  file->mapping = static_cast<const unsigned char*>(mem);
+  file->mapping_size = info.st_size;
+#else
+  std::ifstream in(path, std::ios::in | std::ios::binary);
+  if(!in)
+  {
+    error = bytecode_error::CannotOpen;
+    return nullptr;
+  }
+  file->fallback.assign(std::istreambuf_iterator<char>(in), std::istreambuf_iterator<char>());
+  file->mapping_size = file->fallback.size();
+#endif
+
+  error = file->parse(check_checksum);
+  if(error != bytecode_error::None)
+    return nullptr;
+  return file;
+}
+
+bytecode_error bytecode_file::parse(bool check_checksum)
+{
+  const unsigned char* const data = mapping != nullptr ? mapping : fallback.data();
+  const std::size_t size = mapping_size;
+
+  if(size < header_size)
+    return bytecode_error::Truncated;
+  if(!std::equal(magic.begin(), magic.end(), data))
+    return bytecode_error::BadMagic;
+  if(get16(data + version_field) != bytecode_version)
+    return bytecode_error::UnsupportedVersion;
+
+  // all in 64 bits, so that none of the sums below can overflow
+  const std::uint64_t code_offset = get32(data + code_offset_field);
+  const std::uint64_t code_size = get32(data + code_size_field);
+  const std::uint64_t symbols_offset = get32(data + symbols_offset_field);
+  const std::uint64_t symbol_count = get32(data + symbol_count_field);
+  const std::uint64_t strings_offset = get32(data + strings_offset_field);
+  const std::uint64_t strings_size = get32(data + strings_size_field);
+
+  if(code_offset < header_size || code_offset + code_size > size
+  || symbols_offset < header_size || symbols_offset + symbol_count * symbol_size > size
+  || strings_offset < header_size || strings_offset + strings_size > size)
+    return bytecode_error::BadSection;
+
+  if(check_checksum && crc32(data + header_size, size - header_size) != get32(data + checksum_field))
+    return bytecode_error::ChecksumMismatch;
+
+  code_section = bytecode_view(data + code_offset, code_size);
+
+  syms.reserve(symbol_count);
+  for(std::size_t i = 0; i < symbol_count; ++i)
+  {
+    const unsigned char* const entry = data + symbols_offset + i * symbol_size;
+
+    const std::uint64_t name_offset = get32(entry + 0);
+    const std::uint64_t name_size = get32(entry + 4);
+    const std::uint64_t offset = get32(entry + 8);
+    if(name_offset + name_size > strings_size)
+      return bytecode_error::BadSection;
+
+    // a label may point right behind the last instruction, but not any further
+    if(offset > code_size || entry[12] > static_cast<unsigned char>(ass::symbol_type::Label))
+      return bytecode_error::BadSection;
+
+    const char* const name = reinterpret_cast<const char*>(data + strings_offset + name_offset);
+    syms.push_back({ std::string_view(name, name_size), static_cast<ass::symbol_type>(entry[12]), offset });
+  }
+  return bytecode_error::None;
+}
+
+bytecode_view bytecode_file::code() const
+{ return code_section; }
+
+const std::vector<ass::symbol_entry>& bytecode_file::symbols() const
+{ return syms; }
+
+std::shared_ptr<const vm_program> bytecode_file::load(bool predecode) const
+{ return std::make_shared<const vm_program>(code_section, shared_from_this(), predecode); }
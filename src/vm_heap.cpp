@@ -0,0 +1,69 @@
+#include <vm_heap.hpp>
+
+#include <cstring>
+#include <new>
+#include <algorithm>
+
+vm_heap::vm_heap(std::size_t initial_size)
+  : chunks(std::max<std::size_t>(1, (initial_size + chunk_size - 1) / chunk_size)),
+    used_chunks(), large_blocks(), slots({ { nullptr, 0 } }), current(0), bump(0), allocated_bytes(0)
+{  }
+
+vm_heap::address vm_heap::allocate(std::size_t size)
+{
+  const std::size_t rounded = (size + alignment - 1) & ~(alignment - 1);
+  if(rounded < size)
+    return 0;
+
+  try
+  {
+    if(rounded > chunk_size)
+    {
+      // spans several slots, all pointing into the same block
+      large_blocks.emplace_back(new unsigned char[rounded]());
+      unsigned char* const block = large_blocks.back().get();
+
+      const address addr = static_cast<address>(slots.size()) << chunk_bits;
+      for(std::size_t offset = 0; offset < rounded; offset += chunk_size)
+        slots.push_back({ block + offset, rounded - offset });
+
+      allocated_bytes += rounded;
+      return addr;
+    }
+
+    if(current == 0 || bump + rounded > chunk_size)
+    {
+      chunk* c = chunks.alloc();
+      used_chunks.push_back(c);
+
+      current = slots.size();
+      slots.push_back({ c->bytes, chunk_size });
+      bump = 0;
+    }
+  }
+  catch(const std::bad_alloc&)
+  { return 0; }
+
+  const address addr = (static_cast<address>(current) << chunk_bits) | bump;
+  std::memset(slots[current].base + bump, 0, rounded);
+
+  bump += rounded;
+  allocated_bytes += rounded;
+  return addr;
+}
+
+void vm_heap::reset()
+{
+  for(chunk* c : used_chunks)
+    chunks.free(c);
+  used_chunks.clear();
+  large_blocks.clear();
+
+  slots.resize(1);
+  current = 0;
+  bump = 0;
+  allocated_bytes = 0;
+}
+
+std::size_t vm_heap::allocated() const
+{ return allocated_bytes; }
@@ -0,0 +1,282 @@
+#include <vm_jit.hpp>
+
+#include <initializer_list>
+#include <cassert>
+
+#if H_LANG_VM_HAS_JIT
+#include <sys/mman.h>
+#endif
+
+static constexpr std::uint32_t uncompilable = static_cast<std::uint32_t>(-1);
+
+// bounds the size of a single block, so that a block always fits into the remaining buffer
+static constexpr std::size_t max_block_instructions = 128;
+static constexpr std::size_t max_template_size = 32;
+
+vm_jit::vm_jit(std::size_t threshold, std::size_t code_size)
+  : threshold(threshold), code(nullptr), code_size(code_size), code_used(0),
+    blocks(), counters(), block_count(0)
+{
+#if H_LANG_VM_HAS_JIT
+  void* mem = mmap(nullptr, code_size, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+  if(mem != MAP_FAILED)
+    code = static_cast<unsigned char*>(mem);
+#endif
+}
+
+vm_jit::~vm_jit()
+{
+#if H_LANG_VM_HAS_JIT
+  if(code != nullptr)
+    munmap(code, code_size);
+#endif
+}
+
+void vm_jit::reset(std::size_t program_size)
+{
+  blocks.assign(program_size, nullptr);
+  counters.assign(program_size, 0);
+  block_count = 0;
+  code_used = 0;
+}
+
+std::size_t vm_jit::compiled_blocks() const
+{ return block_count; }
+
+void vm_jit::set_threshold(std::size_t threshold)
+{ this->threshold = threshold; }
+
+bool vm_jit::ends_block(op_code op)
+{
+  switch(op)
+  {
+  default:
+    return false;
+
+  case op_code::HALT:
+  case op_code::DIV:
+  case op_code::ALLOC:
+  case op_code::LOADM:
+  case op_code::STOREM:
+  case op_code::JMP:
+  case op_code::JMPREL:
+  case op_code::JMP_CMP:
+  case op_code::JMP_NCMP:
+  case op_code::EQUAL_JMP_CMP:
+  case op_code::INC_LESS_JMP_CMP:
+  case op_code::UNKNOWN:
+    return true;
+  }
+}
+
+vm_jit::block_fn vm_jit::enter(bytecode_view program, std::size_t pc)
+{
+  if(blocks[pc] != nullptr)
+    return blocks[pc];
+  if(counters[pc] == uncompilable || ++counters[pc] < threshold)
+    return nullptr;
+
+  blocks[pc] = compile(program, pc);
+  if(blocks[pc] == nullptr)
+    counters[pc] = uncompilable;
+  else
+    ++block_count;
+  return blocks[pc];
+}
+
+#if H_LANG_VM_HAS_JIT
+
+static_assert(sizeof(std::int_fast32_t) == 8, "Templates address registers as qwords.");
+static_assert(sizeof(bool) == 1, "Templates write the compare flag as a byte.");
+
+namespace
+{
+
+// Register usage of the templates:
+//   rdi   register array
+//   rsi   compare flag
+//   eax, ecx, edx scratch, eax holds the program counter to continue at on return
+struct emitter
+{
+  unsigned char* at;
+
+  void bytes(std::initializer_list<unsigned char> bs)
+  { for(auto b : bs) *at++ = b; }
+
+  void u32(std::uint32_t v)
+  { for(int i = 0; i < 4; ++i) *at++ = (v >> (8 * i)) & 0xFF; }
+
+  void u64(std::uint64_t v)
+  { for(int i = 0; i < 8; ++i) *at++ = (v >> (8 * i)) & 0xFF; }
+
+  static std::uint32_t reg(unsigned char r)
+  { return r * sizeof(std::int_fast32_t); }
+
+  // regs[r] = value
+  void store(unsigned char r, std::int64_t value)
+  {
+    if(INT32_MIN <= value && value <= INT32_MAX)
+    {
+      bytes({ 0x48, 0xC7, 0x87 }); u32(reg(r)); u32(static_cast<std::uint32_t>(value)); // mov qword [rdi+r], imm32
+    }
+    else
+    {
+      bytes({ 0x48, 0xB8 }); u64(static_cast<std::uint64_t>(value));                  // movabs rax, imm64
+      bytes({ 0x48, 0x89, 0x87 }); u32(reg(r));                                        // mov [rdi+r], rax
+    }
+  }
+
+  void inc(unsigned char r)
+  { bytes({ 0x48, 0xFF, 0x87 }); u32(reg(r)); } // inc qword [rdi+r]
+
+  void dec(unsigned char r)
+  { bytes({ 0x48, 0xFF, 0x8F }); u32(reg(r)); } // dec qword [rdi+r]
+
+  // compare_flag = (int8) regs[a] <cc> (int8) regs[b]
+  void compare(unsigned char setcc, unsigned char a, unsigned char b)
+  {
+    bytes({ 0x0F, 0xBE, 0x87 }); u32(reg(a)); // movsx eax, byte [rdi+a]
+    bytes({ 0x0F, 0xBE, 0x8F }); u32(reg(b)); // movsx ecx, byte [rdi+b]
+    bytes({ 0x39, 0xC8 });                    // cmp eax, ecx
+    bytes({ 0x0F, setcc, 0x06 });             // setcc byte [rsi]
+  }
+
+  void ret(std::uint32_t pc)
+  {
+    bytes({ 0xB8 }); u32(pc); // mov eax, pc
+    bytes({ 0xC3 });          // ret
+  }
+
+  // return compare_flag ? taken : fallthrough   (inverted for cmovcc == cmove)
+  void ret_cond(unsigned char cmovcc, std::uint32_t taken, std::uint32_t fallthrough)
+  {
+    bytes({ 0x80, 0x3E, 0x00 });              // cmp byte [rsi], 0
+    bytes({ 0xB8 }); u32(fallthrough);        // mov eax, fallthrough
+    bytes({ 0xBA }); u32(taken);              // mov edx, taken
+    bytes({ 0x0F, cmovcc, 0xC2 });            // cmovcc eax, edx
+    bytes({ 0xC3 });                          // ret
+  }
+};
+
+constexpr unsigned char sete = 0x94, setl = 0x9C, setge = 0x9D, setle = 0x9E, setg = 0x9F;
+constexpr unsigned char cmove = 0x44, cmovne = 0x45;
+
+}
+
+vm_jit::block_fn vm_jit::compile(bytecode_view program, std::size_t pc)
+{
+  if(code == nullptr || code_used + (max_block_instructions + 1) * max_template_size > code_size)
+    return nullptr;
+  if(mprotect(code, code_size, PROT_READ | PROT_WRITE) != 0)
+    return nullptr;
+
+  unsigned char* const start = code + code_used;
+  emitter e { start };
+
+  std::size_t offset = pc;
+  std::size_t emitted = 0;
+  for(bool done = false; !done; ++emitted)
+  {
+    if(offset >= program.size() || emitted == max_block_instructions)
+    {
+      e.ret(offset);
+      break;
+    }
+    op_code op = byte_to_opcode(program[offset]);
+
+    // superinstructions are compiled as the sequence they stand for, which is still in place
+    if(const auto* fused = find_superinstruction(op))
+      op = fused->sequence.front();
+
+    const std::size_t next = offset + instruction_length(op);
+    const auto arg = [&program, offset](std::size_t i) { return program[offset + i]; };
+
+    bool has_template = true;
+    switch(op)
+    {
+    default:
+      has_template = false;
+      break;
+
+    case op_code::LOAD:
+      e.store(arg(1), ((arg(2) << 8) | arg(3)) & 0b1111111111111111);
+      break;
+
+    // the vm reads the operands of these as immediates
+    case op_code::ADD:
+      e.store(arg(1), static_cast<std::int_fast8_t>(arg(2)) + static_cast<std::int_fast8_t>(arg(3)));
+      break;
+    case op_code::SUB:
+      e.store(arg(1), static_cast<std::int_fast8_t>(arg(2)) - static_cast<std::int_fast8_t>(arg(3)));
+      break;
+    case op_code::MUL:
+      e.store(arg(1), static_cast<std::int_fast8_t>(arg(2)) * static_cast<std::int_fast8_t>(arg(3)));
+      break;
+
+    case op_code::SHIFT_LEFT:
+    case op_code::SHIFT_RIGHT:
+      {
+        const std::size_t reg = arg(1);
+        const std::int_fast8_t by = arg(2);
+
+        // undefined in the interpreter as well, don't bake anything in
+        if(by < 0 || by >= 64)
+          has_template = false;
+        else
+          e.store(reg, static_cast<std::int_fast32_t>(op == op_code::SHIFT_LEFT ? reg << by : reg >> by));
+      } break;
+
+    case op_code::INC: e.inc(arg(1)); break;
+    case op_code::DEC: e.dec(arg(1)); break;
+
+    case op_code::EQUAL:         e.compare(sete,  arg(1), arg(2)); break;
+    case op_code::GREATER:       e.compare(setg,  arg(1), arg(2)); break;
+    case op_code::LESS:          e.compare(setl,  arg(1), arg(2)); break;
+    case op_code::GREATER_EQUAL: e.compare(setge, arg(1), arg(2)); break;
+    case op_code::LESS_EQUAL:    e.compare(setle, arg(1), arg(2)); break;
+
+    case op_code::JMPREL:
+      e.ret(next + arg(1));
+      done = true;
+      break;
+
+    case op_code::JMP_CMP:
+      e.ret_cond(cmovne, next + static_cast<std::int_fast8_t>(arg(1)), next);
+      done = true;
+      break;
+
+    case op_code::JMP_NCMP:
+      e.ret_cond(cmove, next + static_cast<std::int_fast8_t>(arg(1)), next);
+      done = true;
+      break;
+    }
+
+    if(!has_template)
+    {
+      // let the interpreter handle it
+      if(emitted == 0)
+      {
+        mprotect(code, code_size, PROT_READ | PROT_EXEC);
+        return nullptr;
+      }
+      e.ret(offset);
+      break;
+    }
+    offset = next;
+  }
+  assert(static_cast<std::size_t>(e.at - start) <= (max_block_instructions + 1) * max_template_size);
+
+  code_used += e.at - start;
+  if(mprotect(code, code_size, PROT_READ | PROT_EXEC) != 0)
+    return nullptr;
+
+  return reinterpret_cast<block_fn>(start);
+}
+
+#else
+
+vm_jit::block_fn vm_jit::compile(bytecode_view program, std::size_t pc)
+{ return nullptr; }
+
+#endif
+
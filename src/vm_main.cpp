@@ -2,10 +2,36 @@
 #include <vector>
 
 #include <diagnostic.hpp>
+#include <vm_bytecode.hpp>
 #include <repl.hpp>
 
+#include <fmt/format.h>
+
 int main(int argc, char** argv)
 {
+  // hx-vm <file> runs a bytecode file and prints the registers
+  if(argc > 1)
+  {
+    bytecode_error error;
+    auto file = bytecode_file::open(argv[1], error);
+    if(file == nullptr)
+    {
+      fmt::print(stderr, "Could not load \"{}\": {}.\n", argv[1], bytecode_error_to_str(error));
+      return 1;
+    }
+
+    vm virt_mach;
+    virt_mach.set_program(file->load(true));
+    virt_mach.run();
+
+    fmt::print("Registers: [{}", virt_mach.registers().front());
+    for(auto it = std::next(virt_mach.registers().begin()); it != virt_mach.registers().end(); ++it)
+      fmt::print(", {}", *it);
+    fmt::print("]\n");
+
+    return 0;
+  }
+
   virt::REPL repl;
 
   repl.run();
@@ -13,4 +39,3 @@ int main(int argc, char** argv)
   diagnostic.print(stdout);
   return diagnostic.error_code();
 }
-
@@ -0,0 +1,121 @@
+#include <vm_pool.hpp>
+
+#include <thread>
+#include <atomic>
+#include <limits>
+#include <algorithm>
+#include <cassert>
+
+namespace
+{
+
+// The inputs [begin, end) a worker still has to run. Both bounds live in one word, so the owner
+//  taking from the front and a thief taking from the back can't both get the same input.
+struct alignas(64) work_range
+{
+  std::atomic<std::uint64_t> bounds { 0 };
+
+  static constexpr std::uint64_t pack(std::uint64_t begin, std::uint64_t end)
+  { return (begin << 32) | end; }
+
+  static constexpr std::uint32_t begin(std::uint64_t bounds)
+  { return bounds >> 32; }
+
+  static constexpr std::uint32_t end(std::uint64_t bounds)
+  { return bounds & 0xFFFFFFFF; }
+
+  // Takes the next input from the front, only ever called by the owner.
+  bool pop(std::uint32_t& index)
+  {
+    std::uint64_t b = bounds.load(std::memory_order_acquire);
+    while(begin(b) < end(b))
+    {
+      if(bounds.compare_exchange_weak(b, pack(begin(b) + 1, end(b)), std::memory_order_acq_rel))
+      {
+        index = begin(b);
+        return true;
+      }
+    }
+    return false;
+  }
+
+  // Moves the back half of the remaining inputs of `victim` into this range, which has to be empty.
+  bool steal_from(work_range& victim)
+  {
+    std::uint64_t b = victim.bounds.load(std::memory_order_acquire);
+    while(begin(b) < end(b))
+    {
+      const std::uint32_t mid = begin(b) + (end(b) - begin(b)) / 2;
+
+      if(victim.bounds.compare_exchange_weak(b, pack(begin(b), mid), std::memory_order_acq_rel))
+      {
+        bounds.store(pack(mid, end(b)), std::memory_order_release);
+        return true;
+      }
+    }
+    return false;
+  }
+};
+
+}
+
+vm_pool::vm_pool(std::shared_ptr<const vm_program> program, std::size_t threads, vm_dispatch dispatch,
+                 std::size_t heap_size)
+  : program(std::move(program)),
+    threads(threads != 0 ? threads : std::max(1U, std::thread::hardware_concurrency())),
+    dispatch(dispatch), heap_size(heap_size)
+{  }
+
+std::size_t vm_pool::thread_count() const
+{ return threads; }
+
+std::vector<vm_pool::register_file> vm_pool::run(const std::vector<register_file>& inputs) const
+{
+  assert(inputs.size() <= std::numeric_limits<std::uint32_t>::max() && "Too many inputs for one batch.");
+
+  std::vector<register_file> results(inputs.size());
+
+  const std::size_t workers = std::max<std::size_t>(1, std::min(threads, inputs.size()));
+  std::vector<work_range> ranges(workers);
+  for(std::size_t i = 0; i < workers; ++i)
+    ranges[i].bounds = work_range::pack(inputs.size() * i / workers, inputs.size() * (i + 1) / workers);
+
+  const auto work = [&](std::size_t id)
+  {
+    vm v(heap_size, dispatch);
+    v.set_program(program);
+
+    for(;;)
+    {
+      std::uint32_t index;
+      while(ranges[id].pop(index))
+      {
+        v.reset();
+        v.set_registers(inputs[index]);
+        v.run();
+
+        results[index] = v.registers();
+      }
+
+      // inputs that are being stolen right now are neither here nor there, but the thief runs them
+      bool stolen = false;
+      for(std::size_t i = 1; i < workers && !stolen; ++i)
+        stolen = ranges[id].steal_from(ranges[(id + i) % workers]);
+
+      if(!stolen)
+        return;
+    }
+  };
+
+  std::vector<std::thread> pool;
+  pool.reserve(workers - 1);
+  for(std::size_t id = 1; id < workers; ++id)
+    pool.emplace_back(work, id);
+
+  work(0);
+
+  for(auto& t : pool)
+    t.join();
+
+  return results;
+}
@@ -0,0 +1,67 @@
+#include <vm_profiler_json.hpp>
+
+vm_profile::vm_profile(std::size_t cycle_sample_rate)
+  : opcodes(), heat(), total(0), cycle_sample_rate(cycle_sample_rate), since_sample(0),
+    sampled(no_sample), sample_start(0)
+{  }
+
+void vm_profile::finish()
+{
+#if H_LANG_VM_HAS_TSC
+  if(sampled != no_sample)
+  {
+    opcodes[sampled].cycles += __rdtsc() - sample_start;
+    ++opcodes[sampled].samples;
+  }
+#endif
+  sampled = no_sample;
+}
+
+void vm_profile::reset()
+{
+  opcodes.fill({});
+  heat.clear();
+  total = 0;
+  since_sample = 0;
+  sampled = no_sample;
+}
+
+std::uint64_t vm_profile::instructions() const
+{ return total; }
+
+std::size_t vm_profile::sample_rate() const
+{ return cycle_sample_rate; }
+
+const vm_profile::opcode_stats& vm_profile::operator[](op_code op) const
+{ return opcodes[std::min<std::size_t>(opcode_to_byte(op), opcode_count - 1)]; }
+
+const std::vector<std::uint64_t>& vm_profile::heat_map() const
+{ return heat; }
+
+void to_json(nlohmann::json& j, const vm_profile& profile)
+{
+  nlohmann::json ops = nlohmann::json::object();
+  for(std::size_t i = 0; i < vm_profile::opcode_count; ++i)
+  {
+    const op_code op = byte_to_opcode(i);
+    const auto& stats = profile[op];
+    if(stats.count == 0)
+      continue;
+
+    ops[std::string(opcode_to_str(op))] = { { "count", stats.count },
+                                            { "samples", stats.samples },
+                                            { "cycles", stats.cycles } };
+  }
+
+  nlohmann::json heat = nlohmann::json::array();
+  for(std::size_t pc = 0; pc < profile.heat_map().size(); ++pc)
+  {
+    if(profile.heat_map()[pc] != 0)
+      heat.push_back({ { "pc", pc }, { "count", profile.heat_map()[pc] } });
+  }
+
+  j = { { "instructions", profile.instructions() },
+        { "cycle_sample_rate", profile.sample_rate() },
+        { "opcodes", ops },
+        { "heat_map", heat } };
+}
@@ -0,0 +1,96 @@
+#include <vm_verifier.hpp>
+#include <vm.hpp>
+
+std::string_view verify_error_to_str(verify_error err)
+{
+  switch(err)
+  {
+  default:
+  case verify_error::None: return "None";
+  case verify_error::UnknownOpcode: return "Unknown opcode";
+  case verify_error::TruncatedInstruction: return "Instruction is missing operands";
+  case verify_error::InvalidRegister: return "Register does not exist";
+  case verify_error::JumpOutOfProgram: return "Jump target is outside of the program";
+  case verify_error::JumpIntoInstruction: return "Jump target is not an instruction boundary";
+  case verify_error::MissingHalt: return "Program does not end with halt";
+  case verify_error::BrokenSuperinstruction: return "Superinstruction is not followed by its sequence";
+  }
+}
+
+verification verify_program(const std::vector<unsigned char>& program)
+{ return verify_program(bytecode_view(program)); }
+
+verification verify_program(bytecode_view program)
+{
+  verification result;
+  result.instruction_starts.assign(program.size(), false);
+
+  const auto fail = [&result](verify_error err, std::size_t offset)
+  {
+    result.error = err;
+    result.offset = offset;
+    result.instruction_starts.clear();
+    return result;
+  };
+
+  std::vector<std::pair<std::size_t, std::size_t>> jumps; // (instruction, target)
+  std::vector<std::pair<std::size_t, const superinstruction*>> fused_at;
+  op_code last = op_code::HALT;
+  for(std::size_t offset = 0; offset < program.size(); )
+  {
+    const op_code op = byte_to_opcode(program[offset]);
+    if(opcode_to_byte(op) >= opcode_to_byte(op_code::UNKNOWN))
+      return fail(verify_error::UnknownOpcode, offset);
+
+    const std::size_t len = instruction_length(op);
+    if(offset + len > program.size())
+      return fail(verify_error::TruncatedInstruction, offset);
+
+    for(std::size_t i = 1; i <= register_operands(op); ++i)
+      if(program[offset + i] >= vm::register_count)
+        return fail(verify_error::InvalidRegister, offset);
+
+    // same target computation as in the vm
+    switch(op)
+    {
+    case op_code::JMPREL:
+      jumps.emplace_back(offset, offset + len + program[offset + 1]);
+      break;
+
+    case op_code::JMP_CMP:
+    case op_code::JMP_NCMP:
+      jumps.emplace_back(offset, offset + len + static_cast<std::int_fast8_t>(program[offset + 1]));
+      break;
+    }
+    if(const auto* fused = find_superinstruction(op))
+      fused_at.emplace_back(offset, fused);
+
+    result.instruction_starts[offset] = true;
+    last = op;
+    offset += len;
+  }
+  if(!program.empty() && last != op_code::HALT && last != op_code::JMP)
+    return fail(verify_error::MissingHalt, program.size() - 1);
+
+  // the vm executes the rest of a superinstruction's sequence without looking at its opcodes
+  for(auto [offset, fused] : fused_at)
+  {
+    std::size_t next = offset + instruction_length(fused->sequence.front());
+    for(std::size_t i = 1; i < fused->count; ++i)
+    {
+      if(next >= program.size() || byte_to_opcode(program[next]) != fused->sequence[i])
+        return fail(verify_error::BrokenSuperinstruction, offset);
+      next += instruction_length(fused->sequence[i]);
+    }
+  }
+
+  for(auto [offset, target] : jumps)
+  {
+    if(target >= program.size())
+      return fail(verify_error::JumpOutOfProgram, offset);
+    if(!result.instruction_starts[target])
+      return fail(verify_error::JumpIntoInstruction, offset);
+  }
+  return result;
+}
+
@@ -0,0 +1,50 @@
+#include <catch2/catch.hpp>
+
+#include <ast_arena.hpp>
+#include <ast.hpp>
+
+#include <algorithm>
+#include <array>
+#include <cstdint>
+#include <vector>
+
+TEST_CASE( "ast_arena", "" ) {
+  SECTION( "nodes" ) {
+    ast_arena arena;
+
+    std::vector<ast_ptr> nodes;
+    for(std::size_t i = 0; i < 10000; ++i)
+      nodes.push_back(arena.make<app>(arena.make<type>(), arena.make<identifier>("x")));
+
+    REQUIRE((std::all_of(nodes.begin(), nodes.end(), [](ast_ptr n)
+      { return n->kind == ASTNodeKind::app && reinterpret_cast<std::uintptr_t>(n) % alignof(app) == 0; })));
+    REQUIRE((static_cast<app*>(nodes.back())->rhs->kind == ASTNodeKind::identifier));
+    REQUIRE((arena.size() >= 10000 * (sizeof(app) + sizeof(type) + sizeof(identifier))));
+
+    // larger than any block so far
+    auto big = arena.make<std::array<char, 1 << 20>>();
+    REQUIRE((big != nullptr));
+  }
+
+  SECTION( "destructors" ) {
+    struct counted
+    {
+      counted(std::size_t& destroyed) : destroyed(destroyed) {}
+      ~counted() { ++destroyed; }
+
+      std::size_t& destroyed;
+    };
+
+    std::size_t destroyed = 0;
+    {
+      ast_arena arena;
+      for(std::size_t i = 0; i < 100; ++i)
+        arena.make<counted>(destroyed);
+
+      // only the arena the nodes were moved to destroys them
+      ast_arena moved(std::move(arena));
+      REQUIRE((destroyed == 0));
+    }
+    REQUIRE((destroyed == 100));
+  }
+}
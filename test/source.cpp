@@ -0,0 +1,180 @@
+#define CATCH_CONFIG_ENABLE_BENCHMARKING
+#include <catch2/catch.hpp>
+
+#include <text_scan.hpp>
+#include <source_file.hpp>
+#include <stream_lookup.hpp>
+
+#include <algorithm>
+#include <filesystem>
+#include <cstring>
+#include <cctype>
+#include <sstream>
+#include <fstream>
+#include <string>
+#include <thread>
+#include <vector>
+
+TEST_CASE( "text_scan", "" ) {
+  SECTION( "classification" ) {
+    // every byte at every position of a few vector blocks, so that the vector loops
+    //  and the scalar tails all see each of them
+    for(unsigned c = 0; c < 256; ++c)
+    {
+      for(std::size_t pos = 0; pos < 70; ++pos)
+      {
+        std::string word(80, 'x');
+        word[pos] = static_cast<char>(c);
+        const char* hit = find_word_break(word.data(), word.data() + word.size());
+        REQUIRE((hit == word.data() + (is_word_break(word[pos]) ? pos : word.size())));
+
+        std::string spaces(80, ' ');
+        spaces[pos] = static_cast<char>(c);
+        hit = skip_line_spaces(spaces.data(), spaces.data() + spaces.size());
+        REQUIRE((hit == spaces.data() + (is_line_space(spaces[pos]) ? spaces.size() : pos)));
+      }
+    }
+    REQUIRE((is_word_break('\\')));
+    REQUIRE((!is_word_break('_')));
+    REQUIRE((!is_word_break(static_cast<char>(0xC3))));
+  }
+}
+
+TEST_CASE( "source_stream", "" ) {
+  SECTION( "lines" ) {
+    // a line longer than a chunk, an empty line and no '\n' at the very end
+    const std::string long_line(source_stream::chunk_size + 123, 'a');
+    std::istringstream in("first\n" + long_line + "\n\nlast");
+    source_stream stream(in);
+
+    std::string_view line;
+    REQUIRE((stream.next_line(line) && line == "first"));
+    REQUIRE((stream.next_line(line) && line == long_line));
+    REQUIRE((stream.next_line(line) && line.empty()));
+    REQUIRE((stream.next_line(line) && line == "last"));
+    REQUIRE((!stream.next_line(line)));
+    REQUIRE((stream.rows_read() == 4));
+    REQUIRE((stream.kept_line(1) == std::string_view("first")));
+  }
+
+  SECTION( "kept lines" ) {
+    const std::size_t count = source_stream::kept_lines + 10;
+
+    std::string text;
+    for(std::size_t i = 1; i <= count; ++i)
+      text += "line " + std::to_string(i) + "\n";
+    std::istringstream in(text);
+    source_stream stream(in);
+
+    std::string_view line;
+    std::size_t rows = 0;
+    while(stream.next_line(line))
+      REQUIRE((line == "line " + std::to_string(++rows)));
+
+    REQUIRE((rows == count));
+    REQUIRE((stream.first_kept_row() == 11));
+    REQUIRE((!stream.kept_line(10)));
+    REQUIRE((stream.kept_line(11) == std::string_view("line 11")));
+    REQUIRE((stream.kept_line(count) == "line " + std::to_string(count)));
+    REQUIRE((!stream.kept_line(count + 1)));
+  }
+}
+
+TEST_CASE( "stream_lookup", "" ) {
+  const auto dir = std::filesystem::temp_directory_path();
+
+  SECTION( "shared" ) {
+    const std::string path = (dir / "hx_stream_lookup_shared.hx").string();
+    std::ofstream(path) << "x := y;\n";
+
+    auto first = stream_lookup[path];
+    auto second = stream_lookup[path];
+    REQUIRE((first == second));
+    REQUIRE((first->text() == "x := y;\n"));
+
+    // dropping only forgets the module, handles stay valid
+    stream_lookup.drop(path);
+    REQUIRE((first->text() == "x := y;\n"));
+    REQUIRE((stream_lookup[path] != first));
+
+    stream_lookup.drop(path);
+    std::filesystem::remove(path);
+  }
+
+  SECTION( "concurrent" ) {
+    constexpr std::size_t modules = 8;
+
+    std::vector<std::string> paths;
+    for(std::size_t i = 0; i < modules; ++i)
+    {
+      paths.push_back((dir / ("hx_stream_lookup_" + std::to_string(i) + ".hx")).string());
+      std::ofstream(paths.back()) << "module " << i;
+    }
+
+    std::vector<std::thread> threads;
+    std::vector<char> ok(4, true);
+    for(std::size_t t = 0; t < ok.size(); ++t)
+    {
+      threads.emplace_back([t, &ok, &paths]()
+      {
+        for(std::size_t i = 0; i < 500; ++i)
+        {
+          const std::size_t m = (i + t) % paths.size();
+          auto src = stream_lookup[paths[m]];
+          if(src->text() != "module " + std::to_string(m))
+            ok[t] = false;
+          if(i % 3 == t % 3)
+            stream_lookup.drop(paths[m]);
+        }
+      });
+    }
+    for(auto& t : threads)
+      t.join();
+
+    REQUIRE((std::all_of(ok.begin(), ok.end(), [](char b) { return b; })));
+    for(auto& p : paths)
+    {
+      stream_lookup.drop(p);
+      std::filesystem::remove(p);
+    }
+  }
+}
+
+TEST_CASE( "text_scan benchmark", "[.][benchmark]" ) {
+  // a large module of short statements, like the ones we generate
+  std::string text;
+  while(text.size() < (8 << 20))
+    text += "    some_identifier_name := \\ x : Type => function_application x y_with_long_name ;\n";
+
+  const char* const first = text.data();
+  const char* const last = text.data() + text.size();
+
+  BENCHMARK( "cctype, one byte at a time" ) {
+    std::size_t words = 0;
+    for(const char* p = first; p != last; )
+    {
+      while(p != last && std::isspace(static_cast<unsigned char>(*p)))
+        ++p;
+      const char* begin = p;
+      while(p != last && !std::iscntrl(static_cast<unsigned char>(*p)) && !std::isspace(static_cast<unsigned char>(*p))
+                      && !std::strchr("\\|:;{}+-*=.()[],", *p))
+        ++p;
+      words += p != begin;
+      p += p != last && p == begin;
+    }
+    return words;
+  };
+
+  BENCHMARK( "text_scan, " + std::string(text_scan_implementation()) ) {
+    std::size_t words = 0;
+    for(const char* p = first; p != last; )
+    {
+      p = skip_line_spaces(p, last);
+      const char* begin = p;
+      p = find_word_break(p, last);
+      words += p != begin;
+      p += p != last && p == begin;
+    }
+    return words;
+  };
+}
@@ -0,0 +1,58 @@
+#include <catch2/catch.hpp>
+
+#include <symbol.hpp>
+
+#include <algorithm>
+#include <string>
+#include <thread>
+#include <vector>
+
+TEST_CASE( "symbol", "" ) {
+  SECTION( "interning" ) {
+    symbol a("interned");
+    symbol b(std::string("interned"));
+
+    REQUIRE((a == b));
+    REQUIRE((&a.get_string() == &b.get_string()));
+    REQUIRE((a.get_string() == "interned"));
+
+    // these collided under the old 32 bit hash and used to be the same symbol
+    REQUIRE((symbol("sym_2666") != symbol("sym_2186")));
+    REQUIRE((symbol("sym_2666").get_string() == "sym_2666"));
+    REQUIRE((symbol("sym_2186").get_string() == "sym_2186"));
+
+    // ids are handed out one after the other
+    const symbol first("dense_first");
+    const symbol second("dense_second");
+    REQUIRE((second.get_id() == first.get_id() + 1));
+    REQUIRE((sizeof(symbol) == 4));
+  }
+
+  SECTION( "concurrent" ) {
+    // enough strings to make every shard grow a few times while the threads are inserting
+    constexpr std::size_t count = 20000;
+
+    std::vector<std::thread> threads;
+    std::vector<char> ok(4, true);
+    for(std::size_t t = 0; t < ok.size(); ++t)
+    {
+      threads.emplace_back([t, &ok]()
+      {
+        for(std::size_t i = 0; i < count; ++i)
+        {
+          // every thread interns the same strings, in a different order
+          const std::string str = "sym_" + std::to_string((i * (2 * t + 1)) % count);
+          symbol s(str);
+
+          if(s.get_string() != str || s != symbol(str))
+            ok[t] = false;
+        }
+      });
+    }
+    for(auto& t : threads)
+      t.join();
+
+    REQUIRE((std::all_of(ok.begin(), ok.end(), [](char b) { return b; })));
+    REQUIRE((symbol("sym_1234").get_string() == "sym_1234"));
+  }
+}
@@ -0,0 +1,57 @@
+#include <catch2/catch.hpp>
+
+#include <thread_pool.hpp>
+
+#include <atomic>
+#include <vector>
+
+TEST_CASE( "thread_pool", "" ) {
+  SECTION( "jobs" ) {
+    thread_pool pool(4);
+    REQUIRE((pool.thread_count() == 4));
+
+    std::atomic<std::size_t> done { 0 };
+    for(std::size_t i = 0; i < 1000; ++i)
+    {
+      pool.submit([&pool, &done]()
+      {
+        // jobs can hand out more work, it goes to the queue of their own worker
+        pool.submit([&done]() { ++done; });
+        ++done;
+      });
+    }
+    pool.wait();
+    REQUIRE((done == 2000));
+
+    // the pool stays usable after waiting
+    pool.submit([&done]() { ++done; });
+    pool.wait();
+    REQUIRE((done == 2001));
+  }
+
+  SECTION( "destruction finishes jobs" ) {
+    std::atomic<std::size_t> done { 0 };
+    {
+      thread_pool pool(2);
+      for(std::size_t i = 0; i < 100; ++i)
+        pool.submit([&done]() { ++done; });
+    }
+    REQUIRE((done == 100));
+  }
+
+  SECTION( "for_each" ) {
+    thread_pool pool(4);
+
+    std::vector<std::size_t> seen(1000, 0);
+    pool.for_each(seen.size(), [&seen](std::size_t i) { ++seen[i]; });
+    REQUIRE((std::all_of(seen.begin(), seen.end(), [](std::size_t n) { return n == 1; })));
+
+    // jobs may run for_each themselves, the calling worker helps instead of blocking
+    std::atomic<std::size_t> done { 0 };
+    pool.for_each(8, [&pool, &done](std::size_t)
+    {
+      pool.for_each(100, [&done](std::size_t) { ++done; });
+    });
+    REQUIRE((done == 800));
+  }
+}
@@ -0,0 +1,167 @@
+#include <catch2/catch.hpp>
+
+#include <type_checking.hpp>
+#include <thread_pool.hpp>
+#include <diagnostic.hpp>
+#include <reader.hpp>
+
+#include <algorithm>
+#include <string>
+#include <vector>
+
+TEST_CASE( "type_checking", "" ) {
+  // many definitions that only depend on the first few, a failing one and a dependent one
+  std::string text = "type Nat : Type;\ndata Zero : Nat;\ndata Succ : Nat -> Nat;\n";
+  for(std::size_t i = 0; i < 64; ++i)
+    text += "n" + std::to_string(i) + " = " + (i % 2 == 0 ? "Succ Zero" : "(\\x. Succ x) : Nat -> Nat") + ";\n";
+  text += "bad = Zero Zero;\nm = Succ n4;\nn5 Zero;\n";
+  // unannotated lambdas that don't check, but are used later on
+  text += "k = \\x. \\y. x;\nkk = k k;\nid = \\x. x;\nu1 = id Zero;\nu2 = id n2;\nw1 = Succ n2;\nw2 = n3 u1;\n";
+
+  auto [ast, sctx] = hx_reader::read_text(text, scoping_context {});
+  REQUIRE((diagnostic.empty()));
+  REQUIRE((ast.data.size() == 77));
+
+  SECTION( "dependencies" ) {
+    auto deps = hx_ast_type_checking::dependencies(ast);
+
+    REQUIRE((deps[0].empty()));
+    REQUIRE((deps[2] == std::vector<std::size_t> { 0 }));
+    REQUIRE((deps[3] == std::vector<std::size_t> { 1, 2 }));
+    REQUIRE((deps[4] == std::vector<std::size_t> { 0, 2 }));
+    REQUIRE((deps[68] == std::vector<std::size_t> { 2, 7 }));
+    REQUIRE((deps[69] == std::vector<std::size_t> { 1, 8 }));
+  }
+
+  SECTION( "parallel and sequential agree" ) {
+    // checking writes types into the terms, every check gets a module of its own
+    auto check = [&text](auto how)
+    {
+      auto [module, module_sctx] = hx_reader::read_text(text, scoping_context {});
+
+      std::vector<json::json> msgs;
+      auto outer = diagnostics_manager::capture(&msgs);
+      const bool checks = how(module);
+      diagnostics_manager::capture(outer);
+      return std::make_pair(checks, msgs);
+    };
+
+    // every statement in one context, one after another
+    auto [one_context_checks, one_context] = check([](const hx_ast& module)
+    {
+      hx_ast_type_checking checker(module);
+      typing_context ctx;
+      ctx.arena = module.arena.get();
+
+      bool checks = true;
+      for(auto& root : module.data)
+        checks = checker.find_type(ctx, root) != nullptr && checks;
+      return checks;
+    });
+    auto [sequential_checks, sequential] = check([](const hx_ast& module) { return module.type_checks(); });
+    thread_pool pool(4);
+    auto [parallel_checks, parallel] = check([&pool](const hx_ast& module) { return module.type_checks(&pool); });
+
+    REQUIRE((!one_context_checks));
+    REQUIRE((one_context.size() > 3));
+    REQUIRE((sequential_checks == one_context_checks));
+    REQUIRE((sequential == one_context));
+    REQUIRE((parallel_checks == one_context_checks));
+    REQUIRE((parallel == one_context));
+  }
+
+  SECTION( "cyclic solutions" ) {
+    // the argument of a self-application would have to be solved with a type containing itself
+    auto [bad, bad_sctx] = hx_reader::read_text("bad2 = \\x. x x;\nbad3 = \\f. \\x. f (x x);\n", scoping_context {});
+    REQUIRE((diagnostic.empty()));
+
+    std::vector<json::json> msgs;
+    auto outer = diagnostics_manager::capture(&msgs);
+    const bool checks = bad.type_checks();
+    diagnostics_manager::capture(outer);
+
+    REQUIRE((!checks));
+    REQUIRE((msgs.size() == 2));
+    REQUIRE((std::all_of(msgs.begin(), msgs.end(), [](auto& msg) { return msg["hrc"] == 54; })));
+  }
+
+  SECTION( "hash-consed terms" ) {
+    ast_arena arena;
+    auto x = arena.make<identifier>("x");
+    auto T = arena.make<type>();
+
+    typing_context ctx;
+    ctx.arena = &arena;
+
+    auto app = ctx.make_app(x, T);
+    REQUIRE((ctx.make_app(x, T) == app));
+    REQUIRE((ctx.make_app(T, x) != app));
+    REQUIRE((ctx.make_lambda(x, app) == ctx.make_lambda(x, ctx.make_app(x, T))));
+    REQUIRE((ctx.make_lambda(x, app) != ctx.make_app(x, app)));
+
+    // substitution keeps what doesn't change and builds the rest from the same nodes
+    REQUIRE((ctx.subst(app) == app));
+  }
+
+  SECTION( "context lookup" ) {
+    ast_arena arena;
+    auto x = arena.make<identifier>("x");
+    auto y = arena.make<identifier>("y");
+    auto z = arena.make<identifier>("z");
+    auto T = arena.make<type>();
+
+    typing_context ctx;
+    ctx.push({ x, T });
+    ctx.push({ y, T });
+    ctx.push({ x, y });
+    REQUIRE((ctx.lookup_id(x) == ctx.begin()));
+    REQUIRE((ctx.lookup_id(ctx.begin() + 1, x) == ctx.begin() + 2));
+    REQUIRE((ctx.lookup_id(z) == ctx.end()));
+
+    // everything behind an insertion is found one further back
+    auto it = ctx.insert(ctx.begin() + 1, { z, T });
+    REQUIRE((it == ctx.begin() + 1));
+    REQUIRE((ctx.lookup_id(z) == ctx.begin() + 1));
+    REQUIRE((ctx.lookup_id(y) == ctx.begin() + 2));
+    REQUIRE((ctx.lookup_id(ctx.begin() + 1, x) == ctx.begin() + 3));
+
+    ctx.truncate(ctx.lookup_id(y));
+    REQUIRE((ctx.size() == 2));
+    REQUIRE((ctx.lookup_id(y) == ctx.end()));
+    REQUIRE((ctx.lookup_id(ctx.begin() + 1, x) == ctx.end()));
+    REQUIRE((ctx.lookup_id(x) == ctx.begin()));
+
+    ctx.clear();
+    REQUIRE((ctx.lookup_id(x) == ctx.end()));
+  }
+
+  SECTION( "context snapshots" ) {
+    ast_arena arena;
+    auto x = arena.make<identifier>("x");
+    auto y = arena.make<identifier>("y");
+    auto z = arena.make<identifier>("z");
+    auto T = arena.make<type>();
+
+    typing_context ctx;
+    ctx.push({ x, T });
+    ctx.push({ y, T });
+
+    auto outer = ctx.save();
+    ctx.insert(ctx.begin(), { z, T });
+    ctx.truncate(ctx.lookup_id(y));
+
+    // kept changes stay until the outer snapshot is rolled back
+    auto inner = ctx.save();
+    ctx.push({ y, x });
+    ctx.keep(inner);
+    REQUIRE((ctx.size() == 3));
+    REQUIRE((ctx.lookup_id(y) == ctx.begin() + 2));
+
+    ctx.rollback(outer);
+    REQUIRE((ctx.size() == 2));
+    REQUIRE((ctx.lookup_id(z) == ctx.end()));
+    REQUIRE((ctx.lookup_id(x) == ctx.begin()));
+    REQUIRE((ctx.lookup_id(y) == ctx.begin() + 1));
+    REQUIRE((ctx.begin()[1].type == T));
+  }
+}
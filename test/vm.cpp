@@ -1,10 +1,17 @@
 #define CATCH_CONFIG_MAIN
+#define CATCH_CONFIG_ENABLE_BENCHMARKING
 #include <catch2/catch.hpp>
 
 #include <vm.hpp>
 #include <vm_opcodes.hpp>
+#include <vm_verifier.hpp>
+#include <assembler.hpp>
+#include <vm_pool.hpp>
+#include <vm_bytecode.hpp>
+#include <vm_profiler_json.hpp>
 
 #include <algorithm>
+#include <filesystem>
 
 TEST_CASE( "vm", "" ) {
   SECTION( "base" ) {
@@ -91,6 +98,499 @@ TEST_CASE( "vm", "" ) {
       // TODO
     }
 
+    SECTION( "dispatch" ) {
+      const auto inc = opcode_to_byte(op_code::INC);
+      const auto lt = opcode_to_byte(op_code::LESS);
+      const auto jcmp = opcode_to_byte(op_code::JMP_CMP);
+
+      // r1 = 10; do { ++r0; } while(r0 < r1);
+      const std::vector<unsigned char> prog = { load, 1, 0, 10,
+                                                inc, 0,
+                                                lt, 0, 1,
+                                                jcmp, static_cast<unsigned char>(-7),
+                                                hlt };
+      vm switched(256, vm_dispatch::Switch);
+      vm threaded(256, vm_dispatch::Threaded);
+      vm unchecked(256, vm_dispatch::Threaded);
+
+      switched.set_program(prog);
+      threaded.set_program(prog);
+      unchecked.set_program(prog);
+
+      switched.run();
+      threaded.run();
+      unchecked.run_unchecked();
+
+      REQUIRE((switched.registers()[0] == 10));
+      REQUIRE((switched.program_counter() == prog.size()));
+
+      REQUIRE((threaded.registers() == switched.registers()));
+      REQUIRE((threaded.program_counter() == switched.program_counter()));
+      REQUIRE((unchecked.registers() == switched.registers()));
+      REQUIRE((unchecked.program_counter() == switched.program_counter()));
+
+      vm predecoded;
+      predecoded.set_program(prog, true);
+
+      REQUIRE(predecoded.is_predecoded());
+
+      predecoded.run();
+
+      REQUIRE((predecoded.registers() == switched.registers()));
+      REQUIRE((predecoded.program_counter() == switched.program_counter()));
+    }
+
+    SECTION( "predecode" ) {
+      const auto jrp = opcode_to_byte(op_code::JMPREL);
+      const auto inc = opcode_to_byte(op_code::INC);
+
+      // jumps into the middle of the LOAD, so this can only run from the bytes
+      virt_mach.set_program({ jrp, 1, load, 0, 0, 42 }, true);
+
+      REQUIRE(!virt_mach.is_predecoded());
+
+      // truncated instruction
+      virt_mach.set_program({ hlt, load, 0 }, true);
+
+      REQUIRE(!virt_mach.is_predecoded());
+
+      // registers that don't exist
+      virt_mach.set_program({ load, 200, 0, 1, hlt }, true);
+
+      REQUIRE(!virt_mach.is_predecoded());
+
+      // running from the bytes doesn't touch them either
+      for(auto dispatch : { vm_dispatch::Switch, vm_dispatch::Threaded })
+      {
+        vm v(256, dispatch);
+        v.set_program({ inc, 1, load, 200, 0, 1, hlt }, true);
+        REQUIRE(!v.is_verified());
+        v.run();
+
+        REQUIRE((v.program_counter() == 2));
+        REQUIRE((v.registers()[1] == 1));
+        REQUIRE((!v.run_next_instr()));
+
+        // same for an instruction that is missing operands
+        v.reset();
+        v.set_program({ inc, 1, load, 0 }, true);
+        v.run();
+
+        REQUIRE((v.program_counter() == 2));
+      }
+
+      // stepping keeps working on the bytes and run() picks up from there
+      virt_mach.set_program({ load, 0, 0, 1, load, 1, 0, 2, hlt }, true);
+
+      REQUIRE(virt_mach.is_predecoded());
+      REQUIRE(virt_mach.run_next_instr());
+      REQUIRE((virt_mach.program_counter() == 4));
+
+      virt_mach.run();
+
+      REQUIRE((virt_mach.registers()[0] == 1));
+      REQUIRE((virt_mach.registers()[1] == 2));
+      REQUIRE((virt_mach.program_counter() == 9));
+    }
+
+    SECTION( "verify" ) {
+      const auto inc = opcode_to_byte(op_code::INC);
+      const auto jmp = opcode_to_byte(op_code::JMP);
+      const auto jcmp = opcode_to_byte(op_code::JMP_CMP);
+
+      REQUIRE(verify_program(std::vector<unsigned char> { }));
+      REQUIRE(verify_program({ load, 0, 0, 1, inc, 0, jcmp, static_cast<unsigned char>(-4), hlt }));
+      REQUIRE(verify_program({ load, 0, 0, 0, jmp, 0 }));
+
+      REQUIRE((verify_program({ unkn, hlt }).error == verify_error::UnknownOpcode));
+      REQUIRE((verify_program({ hlt, load, 0, 0 }).error == verify_error::TruncatedInstruction));
+      REQUIRE((verify_program({ inc, vm::register_count, hlt }).error == verify_error::InvalidRegister));
+
+      // only the destination of add, sub and mul is a register, div reads its operands from registers
+      const auto add = opcode_to_byte(op_code::ADD);
+      const auto div = opcode_to_byte(op_code::DIV);
+      REQUIRE(verify_program({ add, 0, 50, 60, hlt }));
+      REQUIRE((verify_program({ add, vm::register_count, 0, 0, hlt }).error == verify_error::InvalidRegister));
+      REQUIRE((verify_program({ div, 0, 1, vm::register_count, hlt }).error == verify_error::InvalidRegister));
+
+      vm adding;
+      adding.set_program({ add, 0, 50, 60, hlt });
+
+      REQUIRE(adding.is_verified());
+
+      adding.run();
+
+      REQUIRE((adding.registers()[0] == 110));
+      REQUIRE((verify_program({ jcmp, 3, hlt }).error == verify_error::JumpOutOfProgram));
+      REQUIRE((verify_program({ jcmp, 1, inc, 0, hlt }).error == verify_error::JumpIntoInstruction));
+      REQUIRE((verify_program({ hlt, inc, 0 }).error == verify_error::MissingHalt));
+
+      const auto result = verify_program({ inc, 0, jcmp, static_cast<unsigned char>(-1), hlt });
+
+      REQUIRE((result.error == verify_error::JumpIntoInstruction));
+      REQUIRE((result.offset == 2));
+
+      // register jumps into an instruction stop verified programs
+      virt_mach.set_program({ load, 0, 0, 1, jmp, 0, hlt });
+
+      REQUIRE(virt_mach.is_verified());
+
+      virt_mach.run();
+
+      REQUIRE((virt_mach.program_counter() == 1));
+    }
+
+    SECTION( "superinstructions" ) {
+      const auto inc = opcode_to_byte(op_code::INC);
+      const auto lt = opcode_to_byte(op_code::LESS);
+      const auto eq = opcode_to_byte(op_code::EQUAL);
+      const auto jcmp = opcode_to_byte(op_code::JMP_CMP);
+
+      const auto prog = ass::assembler::parse_code("load $0 1 load $1 2 add $2 $0 $1 halt");
+      const auto& bytes = prog.get_bytes();
+
+      REQUIRE((bytes.size() == 13));
+      REQUIRE((bytes.front() == opcode_to_byte(op_code::LOAD_LOAD_ADD)));
+      REQUIRE((bytes[4] == load));
+      REQUIRE(verify_program(bytes));
+
+      vm fused;
+      fused.set_program(bytes);
+      fused.run();
+      virt_mach.set_program(prog.to_u8_vec());
+      virt_mach.run();
+
+      REQUIRE((fused.registers() == virt_mach.registers()));
+
+      // r1 = 10; do { ++r0; } while(r0 < r1); if(r0 != r1) ++r2; ++r3;
+      std::vector<unsigned char> loop = { load, 1, 0, 10,
+                                          inc, 0,
+                                          lt, 0, 1,
+                                          jcmp, static_cast<unsigned char>(-7),
+                                          eq, 0, 1,
+                                          jcmp, 2,
+                                          inc, 2,
+                                          inc, 3,
+                                          hlt };
+      vm reference;
+      reference.set_program(loop);
+      reference.run();
+
+      REQUIRE((reference.registers()[0] == 10));
+      REQUIRE((reference.registers()[2] == 0));
+      REQUIRE((reference.registers()[3] == 1));
+
+      loop[4] = opcode_to_byte(op_code::INC_LESS_JMP_CMP);
+      loop[11] = opcode_to_byte(op_code::EQUAL_JMP_CMP);
+
+      REQUIRE(verify_program(loop));
+
+      for(auto dispatch : { vm_dispatch::Switch, vm_dispatch::Threaded })
+      {
+        for(bool predecode : { false, true })
+        {
+          vm v(256, dispatch);
+          v.set_program(loop, predecode);
+          v.run();
+
+          REQUIRE((v.registers() == reference.registers()));
+          REQUIRE((v.program_counter() == reference.program_counter()));
+        }
+      }
+
+      // a superinstruction without its sequence
+      const std::vector<unsigned char> broken = { opcode_to_byte(op_code::EQUAL_JMP_CMP), 0, 1, inc, 2, hlt };
+      REQUIRE((verify_program(broken).error == verify_error::BrokenSuperinstruction));
+
+      // unverified, it only compares and runs what actually follows
+      for(auto dispatch : { vm_dispatch::Switch, vm_dispatch::Threaded })
+      {
+        for(bool predecode : { false, true })
+        {
+          vm v(256, dispatch);
+          v.set_program(broken, predecode);
+          REQUIRE(!v.is_verified());
+          v.run();
+
+          REQUIRE((v.registers()[2] == 1));
+          REQUIRE((v.program_counter() == broken.size()));
+        }
+      }
+    }
+
+    SECTION( "jit" ) {
+      const auto inc = opcode_to_byte(op_code::INC);
+      const auto dec = opcode_to_byte(op_code::DEC);
+      const auto add = opcode_to_byte(op_code::ADD);
+      const auto sub = opcode_to_byte(op_code::SUB);
+      const auto mul = opcode_to_byte(op_code::MUL);
+      const auto div = opcode_to_byte(op_code::DIV);
+      const auto shl = opcode_to_byte(op_code::SHIFT_LEFT);
+      const auto shr = opcode_to_byte(op_code::SHIFT_RIGHT);
+      const auto eq = opcode_to_byte(op_code::EQUAL);
+      const auto gt = opcode_to_byte(op_code::GREATER);
+      const auto lt = opcode_to_byte(op_code::LESS);
+      const auto ge = opcode_to_byte(op_code::GREATER_EQUAL);
+      const auto le = opcode_to_byte(op_code::LESS_EQUAL);
+      const auto jrp = opcode_to_byte(op_code::JMPREL);
+      const auto jcmp = opcode_to_byte(op_code::JMP_CMP);
+      const auto jncmp = opcode_to_byte(op_code::JMP_NCMP);
+
+      const std::vector<std::vector<unsigned char>> programs = {
+        // r1 = 10; do { ++r0; } while(r0 < r1);
+        { load, 1, 0, 10, inc, 0, lt, 0, 1, jcmp, static_cast<unsigned char>(-7), hlt },
+
+        // same loop as superinstructions
+        { load, 1, 0, 10, opcode_to_byte(op_code::INC_LESS_JMP_CMP), 0, lt, 0, 1, jcmp, static_cast<unsigned char>(-7),
+          opcode_to_byte(op_code::EQUAL_JMP_CMP), 0, 1, jcmp, 2, inc, 2, inc, 3, hlt },
+
+        // every template, with a division in the loop body that the interpreter has to take over
+        { load, 1, 0, 100, load, 2, 1, 2, load, 3, 0, 3,
+          add, 4, 1, 2, sub, 5, 1, 2, mul, 6, 3, 7, shl, 7, 2, shr, 8, 1,
+          inc, 9, dec, 10, dec, 1,
+          div, 11, 2, 3,
+          eq, 1, 2, gt, 1, 2, ge, 1, 2, le, 1, 2, jncmp, 2, inc, 12,
+          lt, 9, 1, jcmp, static_cast<unsigned char>(-49),
+          jrp, 1, hlt, hlt },
+      };
+
+      for(const auto& prog : programs)
+      {
+        REQUIRE(verify_program(prog));
+
+        vm reference(256, vm_dispatch::Switch);
+        reference.set_program(prog);
+        reference.run();
+
+        vm jitted(256, vm_dispatch::Jit);
+        jitted.set_jit_threshold(1);
+        jitted.set_program(prog);
+        jitted.run();
+
+        REQUIRE((jitted.registers() == reference.registers()));
+        REQUIRE((jitted.program_counter() == reference.program_counter()));
+#if H_LANG_VM_HAS_JIT
+        REQUIRE((jitted.jit_compiled_blocks() > 0));
+#endif
+      }
+    }
+
+    SECTION( "profile" ) {
+      const auto inc = opcode_to_byte(op_code::INC);
+      const auto lt = opcode_to_byte(op_code::LESS);
+      const auto jcmp = opcode_to_byte(op_code::JMP_CMP);
+
+      // r1 = 10; do { ++r0; } while(r0 < r1);
+      const std::vector<unsigned char> loop = { load, 1, 0, 10, inc, 0, lt, 0, 1, jcmp, static_cast<unsigned char>(-7), hlt };
+
+      for(auto dispatch : { vm_dispatch::Switch, vm_dispatch::Threaded, vm_dispatch::Jit })
+      {
+        vm reference(256, dispatch);
+        reference.set_program(loop);
+        reference.run();
+
+        vm v(256, dispatch);
+        v.set_program(loop);
+
+        vm_profile profile(1);
+        v.run_profiled(profile);
+
+        REQUIRE((v.registers() == reference.registers()));
+        REQUIRE((profile.instructions() == 1 + 3 * 10 + 1));
+        REQUIRE((profile[op_code::LOAD].count == 1));
+        REQUIRE((profile[op_code::INC].count == 10));
+        REQUIRE((profile[op_code::JMP_CMP].count == 10));
+        REQUIRE((profile[op_code::HALT].count == 1));
+        REQUIRE((profile[op_code::DIV].count == 0));
+
+        REQUIRE((profile.heat_map()[0] == 1));
+        REQUIRE((profile.heat_map()[4] == 10));
+        REQUIRE((profile.heat_map()[5] == 0));
+        REQUIRE((profile.heat_map()[11] == 1));
+#if H_LANG_VM_HAS_TSC
+        REQUIRE((profile[op_code::INC].samples == 10));
+#endif
+
+        const nlohmann::json j = profile;
+        REQUIRE((j["instructions"] == 32));
+        REQUIRE((j["opcodes"]["inc"]["count"] == 10));
+        REQUIRE((j["heat_map"].size() == 5));
+      }
+    }
+
+    SECTION( "pool" ) {
+      const auto inc = opcode_to_byte(op_code::INC);
+      const auto lt = opcode_to_byte(op_code::LESS);
+      const auto jcmp = opcode_to_byte(op_code::JMP_CMP);
+
+      // do { ++r0; } while(r0 < r1);
+      const auto program = std::make_shared<const vm_program>(
+          std::vector<unsigned char> { inc, 0, lt, 0, 1, jcmp, static_cast<unsigned char>(-7), hlt }, true);
+
+      std::vector<vm_pool::register_file> inputs(1000);
+      for(std::size_t i = 0; i < inputs.size(); ++i)
+      {
+        inputs[i].fill(0);
+        inputs[i][1] = i % 100;
+        inputs[i][2] = i;
+      }
+
+      std::vector<vm_pool::register_file> expected;
+      for(const auto& in : inputs)
+      {
+        vm v;
+        v.set_program(program);
+        v.set_registers(in);
+        v.run();
+
+        expected.push_back(v.registers());
+      }
+      REQUIRE((expected[42][0] == 42));
+      REQUIRE((expected[100][0] == 1));
+
+      for(std::size_t threads : { 1, 3, 8 })
+      {
+        vm_pool pool(program, threads);
+
+        REQUIRE((pool.thread_count() == threads));
+        REQUIRE((pool.run(inputs) == expected));
+      }
+      REQUIRE((vm_pool(program, 4).run({}).empty()));
+    }
+
+    SECTION( "heap" ) {
+      const auto aloc = opcode_to_byte(op_code::ALLOC);
+      const auto loadm = opcode_to_byte(op_code::LOADM);
+      const auto storem = opcode_to_byte(op_code::STOREM);
+
+      // r0 = alloc(12); *r0 = 42; r2 = *r0; r3 = *0;
+      const std::vector<unsigned char> prog = { load, 0, 0, 12, aloc, 0,
+                                                load, 1, 0, 42, storem, 0, 1,
+                                                loadm, 2, 0,
+                                                loadm, 3, 4,
+                                                hlt };
+      REQUIRE(verify_program(prog));
+      REQUIRE((ass::assembler::parse_code("loadm $2 $0 storem $0 $1 halt").get_bytes()
+               == std::vector<unsigned char> { loadm, 2, 0, storem, 0, 1, hlt }));
+
+      for(auto dispatch : { vm_dispatch::Switch, vm_dispatch::Threaded, vm_dispatch::Jit })
+      {
+        for(bool predecode : { false, true })
+        {
+          vm v(256, dispatch);
+          v.set_program(prog, predecode);
+          v.run();
+
+          REQUIRE((v.registers()[0] != 0));
+          REQUIRE((v.registers()[2] == 42));
+
+          // address 0 is never backed by memory
+          REQUIRE(v.heap_fault());
+          REQUIRE((v.program_counter() == prog.size() - 1));
+          REQUIRE((v.memory().allocated() == 16));
+
+          v.reset();
+
+          REQUIRE(!v.heap_fault());
+          REQUIRE((v.memory().allocated() == 0));
+        }
+      }
+
+      vm_heap heap;
+      const auto first = heap.allocate(100);
+      unsigned char* const mem = heap.translate(first, 100);
+
+      REQUIRE((mem != nullptr));
+      REQUIRE((heap.translate(first, vm_heap::chunk_size + 1) == nullptr));
+
+      // growing the heap doesn't move live memory
+      const auto large = heap.allocate(3 * vm_heap::chunk_size);
+      for(std::size_t i = 0; i < 10; ++i)
+        REQUIRE((heap.allocate(vm_heap::chunk_size / 2) != 0));
+
+      REQUIRE((heap.translate(first, 100) == mem));
+      REQUIRE((heap.translate(large + 3 * vm_heap::chunk_size - 4, 4) != nullptr));
+      REQUIRE((heap.translate(large + 3 * vm_heap::chunk_size - 4, 5) == nullptr));
+      REQUIRE((heap.translate(large + vm_heap::chunk_size, 4)
+               == heap.translate(large, 4) + vm_heap::chunk_size));
+    }
+
+    SECTION( "bytecode" ) {
+      const auto prog = ass::assembler::parse_code("load $0 7 inc $0 halt");
+      const std::vector<ass::symbol_entry> symbols = { { "start", ass::symbol_type::Label, 0 },
+                                                       { "end", ass::symbol_type::Label, 6 } };
+      auto bytes = emit_bytecode(prog.get_bytes(), symbols);
+
+      REQUIRE((emit_bytecode(prog) == emit_bytecode(prog.get_bytes(), {})));
+
+      const auto path = (std::filesystem::temp_directory_path() / "hx-vm-test.hxbc").string();
+      REQUIRE(write_bytecode(bytes, path));
+
+      bytecode_error error;
+      auto file = bytecode_file::open(path, error);
+
+      REQUIRE((file != nullptr));
+      REQUIRE((error == bytecode_error::None));
+      REQUIRE((std::equal(file->code().begin(), file->code().end(), prog.get_bytes().begin(), prog.get_bytes().end())));
+      REQUIRE((file->symbols().size() == 2));
+      REQUIRE((file->symbols()[1].name == "end"));
+      REQUIRE((file->symbols()[1].offset == 6));
+
+      // runs from the mapping, which outlives the file handle
+      auto program = file->load(true);
+      file.reset();
+
+      vm v;
+      v.set_program(program);
+      v.run();
+
+      REQUIRE((v.get_program().data() == program->bytes.data()));
+      REQUIRE((v.registers()[0] == 8));
+
+      bytes[70] ^= 1;
+      REQUIRE(write_bytecode(bytes, path));
+      REQUIRE((bytecode_file::open(path, error) == nullptr));
+      REQUIRE((error == bytecode_error::ChecksumMismatch));
+      REQUIRE((bytecode_file::open(path, error, false) != nullptr));
+
+      bytes[0] = 'X';
+      REQUIRE(write_bytecode(bytes, path));
+      REQUIRE((bytecode_file::open(path, error) == nullptr));
+      REQUIRE((error == bytecode_error::BadMagic));
+
+      // labels the assembler records are byte offsets, so the loader takes them
+      const auto labelled = ass::assembler::parse_code("load $0 7 again: inc $0 done: halt");
+      REQUIRE(write_bytecode(emit_bytecode(labelled), path));
+
+      file = bytecode_file::open(path, error);
+      REQUIRE((file != nullptr));
+      REQUIRE((file->symbols().size() == 2));
+      REQUIRE((file->symbols()[0].name == "again"));
+      REQUIRE((file->symbols()[0].offset == 4));
+      REQUIRE((file->symbols()[1].name == "done"));
+      REQUIRE((file->symbols()[1].offset == 6));
+      file.reset();
+
+      // symbols pointing past the code or of an unknown type
+      REQUIRE(write_bytecode(emit_bytecode(prog.get_bytes(), { { "past", ass::symbol_type::Label, 8 } }), path));
+      REQUIRE((bytecode_file::open(path, error) == nullptr));
+      REQUIRE((error == bytecode_error::BadSection));
+
+      bytes = emit_bytecode(prog.get_bytes(), symbols);
+      bytes[64 + prog.get_bytes().size() + 12] = 7;
+      REQUIRE(write_bytecode(bytes, path));
+      REQUIRE((bytecode_file::open(path, error, false) == nullptr));
+      REQUIRE((error == bytecode_error::BadSection));
+
+      REQUIRE(write_bytecode({ 'H', 'X', 'B', 'C' }, path));
+      REQUIRE((bytecode_file::open(path, error) == nullptr));
+      REQUIRE((error == bytecode_error::Truncated));
+
+      std::filesystem::remove(path);
+      REQUIRE((bytecode_file::open(path, error) == nullptr));
+      REQUIRE((error == bytecode_error::CannotOpen));
+    }
+
     SECTION( "UNKNOWN" ) {
       std::vector<unsigned char> prog = { unkn, hlt, hlt, hlt };
       virt_mach.set_program(prog);